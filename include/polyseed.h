@@ -19,6 +19,9 @@ typedef uint8_t polyseed_storage[POLYSEED_SIZE];
 /* The maximum possible length of a mnemonic phrase */
 #define POLYSEED_STR_SIZE 360
 
+/* Maximum size of the keyed HMAC-SHA256 state (see hmac_sha256_init) */
+#define POLYSEED_HMAC_STATE_SIZE 256
+
 /* Mnemonic phrase buffer */
 typedef char polyseed_str[POLYSEED_STR_SIZE];
 
@@ -27,12 +30,21 @@ typedef void polyseed_randbytes(void* result, size_t n);
 typedef void polyseed_pbkdf2(const uint8_t* pw, size_t pwlen,
     const uint8_t* salt, size_t saltlen, uint64_t iterations,
     uint8_t* key, size_t keylen);
+typedef void polyseed_hmac_init(const uint8_t* key, size_t keylen,
+    void* state);
+typedef void polyseed_pbkdf2_hmac(const void* state, const uint8_t* salt,
+    size_t saltlen, uint64_t iterations, uint8_t* key, size_t keylen);
+typedef void polyseed_pbkdf2_multi(size_t count, const uint8_t* const* pw,
+    size_t pwlen, const uint8_t* const* salt, size_t saltlen,
+    uint64_t iterations, uint8_t* const* key, size_t keylen);
 typedef size_t polyseed_transform(const char* str, polyseed_str norm);
 typedef uint64_t polyseed_time(void);
 typedef void polyseed_memzero(void* const ptr, const size_t len);
 typedef void* polyseed_malloc(size_t n);
 typedef void polyseed_mfree(void* ptr);
 
+/* Unused optional dependencies must be NULL. New members are only added
+   at the end of the structure together with a new SOVERSION. */
 typedef struct polyseed_dependency {
     /* Function to generate cryptographically secure random bytes */
     polyseed_randbytes* randbytes;
@@ -40,9 +52,11 @@ typedef struct polyseed_dependency {
     polyseed_pbkdf2* pbkdf2_sha256;
     /* Function to securely erase memory */
     polyseed_memzero* memzero;
-    /* Function to convert a UTF8 string to the composed canonical form. */
+    /* UNUSED: Phrases are encoded from precomposed wordlists, so this
+       function is no longer called. May be NULL. */
     polyseed_transform* u8_nfc;
-    /* Function to convert a UTF8 string to the decomposed canonical form. */
+    /* Function to convert a UTF8 string to the decomposed canonical form.
+       Only called for strings that the built-in normalizer doesn't support. */
     polyseed_transform* u8_nfkd;
     /* OPTIONAL: Function to get the current unix time  */
     polyseed_time* time;
@@ -50,6 +64,16 @@ typedef struct polyseed_dependency {
     polyseed_malloc* alloc;
     /* OPTIONAL: Function to free memory */
     polyseed_mfree* free;
+    /* OPTIONAL: Function to calculate count independent PBKDF2-SHA256 keys
+       (e.g. with multi-buffer SHA-256). Used by polyseed_keygen_batch. */
+    polyseed_pbkdf2_multi* pbkdf2_sha256_multi;
+    /* OPTIONAL: Function to precompute the HMAC-SHA256 state for a key
+       (at most POLYSEED_HMAC_STATE_SIZE bytes, must be copyable) and
+       function to calculate PBKDF2-SHA256 with the password given by
+       the precomputed state. Used by polyseed_keygen_multi. Both functions
+       must be provided to be used. */
+    polyseed_hmac_init* hmac_sha256_init;
+    polyseed_pbkdf2_hmac* pbkdf2_sha256_hmac;
 } polyseed_dependency;
 
 /* List of coins. The seeds for different coins are incompatible. */
@@ -80,6 +104,12 @@ typedef enum polyseed_status {
     POLYSEED_ERR_MEMORY = 6,
     /* Phrase matches more than one language */
     POLYSEED_ERR_MULT_LANG = 7,
+    /* Phrase is not a valid UTF8 string */
+    POLYSEED_ERR_UTF8 = 8,
+    /* Asynchronous operation was canceled */
+    POLYSEED_ERR_CANCELED = 9,
+    /* Seed is not encrypted */
+    POLYSEED_ERR_NOT_ENCRYPTED = 10,
 } polyseed_status;
 
 /* Opaque struct with the seed data */
@@ -88,6 +118,19 @@ typedef struct polyseed_data polyseed_data;
 /* Opaque struct with language data */
 typedef struct polyseed_lang polyseed_lang;
 
+/* Opaque struct with the dependencies and enabled features */
+typedef struct polyseed_context polyseed_context;
+
+/* Opaque struct with an encryption mask derived from a password */
+typedef struct polyseed_mask polyseed_mask;
+
+/* Opaque handle of an asynchronous operation */
+typedef struct polyseed_job polyseed_job;
+
+/* Completion callback of an asynchronous operation */
+typedef void polyseed_callback(polyseed_job* job, polyseed_status status,
+    void* userdata);
+
 /*
 Shared/static library definitions 
     - define POLYSEED_SHARED when building a shared library
@@ -129,6 +172,31 @@ extern "C" {
 POLYSEED_API
 void polyseed_inject(const polyseed_dependency* deps);
 
+/**
+ * Built-in allocator for the seed data that can be injected as the alloc
+ * dependency. Seeds are stored in fixed-size slots in memory that is
+ * locked (if permitted by the system limits) and excluded from core dumps.
+ * The allocator is thread-safe and lock-free. The library only requests
+ * blocks of at most polyseed_data_size() bytes (seeds and password masks)
+ * from the alloc dependency, so it can be used as a replacement for malloc.
+ *
+ * @param n is the size of the allocation. Must not be larger than
+ *        polyseed_data_size(), otherwise NULL is returned.
+ *
+ * @return pointer to the allocated memory or NULL if the allocation fails.
+ */
+POLYSEED_API
+void* polyseed_secure_alloc(size_t n);
+
+/**
+ * Releases memory allocated by polyseed_secure_alloc. The memory is erased
+ * before being reused. Can be injected as the free dependency.
+ *
+ * @param ptr is the pointer to be freed. If NULL, no action is performed.
+ */
+POLYSEED_API
+void polyseed_secure_free(void* ptr);
+
 /**
  * @return the number of supported languages.
  */
@@ -180,6 +248,31 @@ const char* polyseed_get_lang_name_en(const polyseed_lang* lang);
 POLYSEED_API
 int polyseed_enable_features(unsigned mask);
 
+/**
+ * Enables or disables the entropy pool. When enabled, random bytes are
+ * requested from the randbytes dependency in large chunks and buffered
+ * per thread. Buffered bytes are erased as soon as they are used and
+ * are discarded in the child process after fork. Disabled by default.
+ *
+ * @param enable is non-zero to enable the pool, zero to disable it.
+ */
+POLYSEED_API
+void polyseed_enable_entropy_pool(int enable);
+
+/**
+ * Enables or disables the key cache. When enabled, polyseed_keygen,
+ * polyseed_keygen_multi and polyseed_keygen_batch remember up to 32 derived
+ * keys of at most 64 bytes in locked memory and return them without
+ * recalculating PBKDF2 if called again with the same seed pointer, seed
+ * contents, coin and key size. The cached keys
+ * of a seed are erased by polyseed_free and polyseed_erase. Disabled by
+ * default.
+ *
+ * @param enable is non-zero to enable the cache, zero to disable it.
+ */
+POLYSEED_API
+void polyseed_enable_keygen_cache(int enable);
+
 /**
  * Creates a new seed with specific features.
  *
@@ -197,6 +290,54 @@ int polyseed_enable_features(unsigned mask);
 POLYSEED_API
 polyseed_status polyseed_create(unsigned features, polyseed_data** seed_out);
 
+/**
+ * Creates a new seed with specific features in caller-provided memory.
+ *
+ * @param features are the values of the boolean features for this seed. Only
+ *        the least significant 3 bits are used.
+ * @param seed is a pointer to memory of at least polyseed_data_size() bytes
+ *        aligned to polyseed_data_align() bytes. Must not be NULL.
+ *        The seed should be erased with polyseed_erase after use.
+ *
+ * @return POLYSEED_OK if the operation was successful.
+ *         POLYSEED_ERR_UNSUPPORTED if requesting features that have not been
+ *         enabled.
+ */
+POLYSEED_API
+polyseed_status polyseed_create_into(unsigned features, polyseed_data* seed);
+
+/**
+ * Creates a batch of new seeds with specific features and serializes them.
+ * The random bytes for up to 64 seeds are requested with a single call to
+ * the randbytes function and all seeds have the same birthday.
+ *
+ * @param features are the values of the boolean features for the seeds.
+ *        Only the least significant 3 bits are used.
+ * @param count is the number of seeds to create.
+ * @param storage_out is an array of count elements where the serialized
+ *        seeds will be stored. Must not be NULL unless count is zero.
+ *
+ * @return POLYSEED_OK if the operation was successful.
+ *         POLYSEED_ERR_UNSUPPORTED if requesting features that have not been
+ *         enabled.
+ */
+POLYSEED_API
+polyseed_status polyseed_create_batch(unsigned features, size_t count,
+    polyseed_storage* storage_out);
+
+/**
+ * @return the size of the seed data in bytes for the functions that use
+ *         caller-provided memory.
+ */
+POLYSEED_API
+size_t polyseed_data_size(void);
+
+/**
+ * @return the required alignment of the seed data in bytes.
+ */
+POLYSEED_API
+size_t polyseed_data_align(void);
+
 /**
  * Securely erases the seed data and releases the allocated memory.
  * This function should be called for pointers obtained from the following
@@ -210,6 +351,15 @@ polyseed_status polyseed_create(unsigned features, polyseed_data** seed_out);
 POLYSEED_API
 void polyseed_free(polyseed_data* seed);
 
+/**
+ * Securely erases the seed data without releasing the memory. This function
+ * should be called for seeds in caller-provided memory.
+ *
+ * @param seed is the pointer to the seed data. Must not be NULL.
+*/
+POLYSEED_API
+void polyseed_erase(polyseed_data* seed);
+
 /**
  * Gets the approximate date when the seed was created.
  *
@@ -244,6 +394,46 @@ POLYSEED_API
 void polyseed_keygen(const polyseed_data* seed, polyseed_coin coin,
     size_t key_size, uint8_t* key_out);
 
+/**
+ * Derives secret keys from a batch of mnemonic seeds. The keys are the same
+ * as the keys derived by polyseed_keygen. If the pbkdf2_sha256_multi
+ * dependency was provided, the keys are derived with up to 16 seeds per
+ * call, otherwise pbkdf2_sha256 is called for each seed.
+ *
+ * @param seeds is an array of count pointers to the seed data.
+ *        Must not be NULL unless count is zero.
+ * @param coins is an array of count coins the keys are intended for.
+ *        Must not be NULL unless count is zero.
+ * @param count is the number of seeds.
+ * @param key_size is the required key size.
+ * @param keys_out is the buffer of count * key_size bytes where the keys
+ *        will be stored back to back. Must not be NULL unless count is zero.
+*/
+POLYSEED_API
+void polyseed_keygen_batch(const polyseed_data* const* seeds,
+    const polyseed_coin* coins, size_t count, size_t key_size,
+    uint8_t* keys_out);
+
+/**
+ * Derives secret keys for several coins from one mnemonic seed. The keys
+ * are the same as the keys derived by polyseed_keygen. If the
+ * hmac_sha256_init and pbkdf2_sha256_hmac dependencies were provided,
+ * the HMAC key state of the seed is computed once and reused for all
+ * coins, otherwise pbkdf2_sha256 is called for each coin.
+ *
+ * @param seed is a pointer to the seed data. Must not be NULL.
+ * @param coins is an array of count coins the keys are intended for.
+ *        Must not be NULL unless count is zero.
+ * @param count is the number of coins.
+ * @param key_size is the required key size.
+ * @param keys_out is the buffer of count * key_size bytes where the keys
+ *        will be stored back to back. Must not be NULL unless count is zero.
+*/
+POLYSEED_API
+void polyseed_keygen_multi(const polyseed_data* seed,
+    const polyseed_coin* coins, size_t count, size_t key_size,
+    uint8_t* keys_out);
+
 /**
  * Encodes the mnemonic seed into a string.
  *
@@ -260,6 +450,39 @@ POLYSEED_API
 size_t polyseed_encode(const polyseed_data* seed, const polyseed_lang* lang,
     polyseed_coin coin, polyseed_str str_out);
 
+/**
+ * Encodes a batch of serialized seeds into mnemonic phrases stored back
+ * to back in one buffer. Each phrase is the same as the output of
+ * polyseed_encode, but without the terminating null.
+ *
+ * @param storage is an array of count serialized seeds. Must not be NULL
+ *        unless count is zero.
+ * @param count is the number of seeds.
+ * @param lang is a pointer to the language to encode the seeds.
+ *        Must not be NULL.
+ * @param coin is the coin the mnemonic phrases are intended for.
+ * @param buffer is the buffer where the phrases will be stored.
+ *        Must not be NULL unless buffer_size is zero.
+ * @param buffer_size is the size of the buffer. A buffer of
+ *        count * (POLYSEED_STR_SIZE - 1) bytes fits any batch.
+ * @param offsets_out is an array of count + 1 elements where the offsets
+ *        of the phrases will be stored. Phrase i consists of the bytes from
+ *        offsets_out[i] to offsets_out[i + 1] (empty for seeds that failed
+ *        to load). Must not be NULL.
+ * @param status_out is an array of count elements where the result of
+ *        loading each seed will be stored. Must not be NULL unless count
+ *        is zero.
+ *
+ * @return the number of seeds that were processed. This is less than
+ *         count if the buffer is too small. Only the first (return value)
+ *         elements of status_out and (return value) + 1 elements of
+ *         offsets_out are valid.
+ */
+POLYSEED_API
+size_t polyseed_encode_batch(const polyseed_storage* storage, size_t count,
+    const polyseed_lang* lang, polyseed_coin coin, char* buffer,
+    size_t buffer_size, size_t* offsets_out, polyseed_status* status_out);
+
 /**
  * Decodes the seed from a mnemonic phrase.
  *
@@ -277,6 +500,94 @@ POLYSEED_API
 polyseed_status polyseed_decode(const char* str, polyseed_coin coin,
     const polyseed_lang** lang_out, polyseed_data** seed_out);
 
+/**
+ * Decodes the seed from a mnemonic phrase that is not null-terminated.
+ * Same as polyseed_decode, but the phrase is read in place without being
+ * copied.
+ *
+ * @param str is the mnemonic phrase. Must not be NULL.
+ * @param length is the length of the phrase in bytes. The phrase ends
+ *        earlier if it contains a null character.
+ * @param coin is the coin the mnemonic phrase is intended for.
+ * @param lang_out is an optional pointer. IF not NULL, the detected language
+ *        of the mnemonic phrase will be stored there.
+ * @param seed_out is a pointer where the seed pointer will be stored.
+ *        Must not be NULL.
+ *
+ * @return POLYSEED_OK if the operation was successful. Other values indicate
+ *         an error (in that case, *lang_out and *seed_out are undefined).
+ */
+POLYSEED_API
+polyseed_status polyseed_decode_n(const char* str, size_t length,
+    polyseed_coin coin, const polyseed_lang** lang_out,
+    polyseed_data** seed_out);
+
+/**
+ * Decodes the seed from a mnemonic phrase into caller-provided memory.
+ *
+ * @param str is the mnemonic phrase as a C-style string. Must not be NULL.
+ * @param coin is the coin the mnemonic phrase is intended for.
+ * @param lang_out is an optional pointer. IF not NULL, the detected language
+ *        of the mnemonic phrase will be stored there.
+ * @param seed is a pointer to memory of at least polyseed_data_size() bytes
+ *        aligned to polyseed_data_align() bytes. Must not be NULL.
+ *        The seed should be erased with polyseed_erase after use.
+ *
+ * @return POLYSEED_OK if the operation was successful. Other values indicate
+ *         an error (in that case, *lang_out is undefined and *seed is not
+ *         modified).
+ */
+POLYSEED_API
+polyseed_status polyseed_decode_into(const char* str, polyseed_coin coin,
+    const polyseed_lang** lang_out, polyseed_data* seed);
+
+/**
+ * Decodes a mnemonic phrase and serializes the seed without keeping it
+ * in memory. Same as polyseed_decode followed by polyseed_store.
+ *
+ * @param str is the mnemonic phrase as a C-style string. Must not be NULL.
+ * @param coin is the coin the mnemonic phrase is intended for.
+ * @param lang_out is an optional pointer. IF not NULL, the detected language
+ *        of the mnemonic phrase will be stored there.
+ * @param storage is the buffer where the seed will be stored.
+ *        Must not be NULL.
+ *
+ * @return POLYSEED_OK if the operation was successful. Other values indicate
+ *         an error (in that case, *lang_out and storage are undefined).
+ */
+POLYSEED_API
+polyseed_status polyseed_decode_storage(const char* str, polyseed_coin coin,
+    const polyseed_lang** lang_out, polyseed_storage storage);
+
+/**
+ * Decodes a batch of mnemonic phrases stored back to back in one buffer
+ * and serializes the seeds. Each phrase is decoded as by polyseed_decode.
+ * The phrases are processed without memory allocations.
+ *
+ * @param buffer is the buffer with the phrases. The phrases don't need to
+ *        be null-terminated. Must not be NULL unless count is zero.
+ * @param offsets is an array of count + 1 offsets into the buffer.
+ *        Phrase i consists of the bytes from offsets[i] to offsets[i + 1]
+ *        (a phrase ends earlier if it contains a null character).
+ *        Must not be NULL.
+ * @param count is the number of phrases.
+ * @param coin is the coin the mnemonic phrases are intended for.
+ * @param status_out is an array of count elements where the result of
+ *        each phrase will be stored. Must not be NULL unless count is zero.
+ * @param lang_out is an optional array of count elements. IF not NULL,
+ *        the detected language of each phrase will be stored there
+ *        (NULL for phrases that failed to decode).
+ * @param storage_out is an array of count elements where the serialized
+ *        seeds will be stored (zeroes for phrases that failed to decode).
+ *        Must not be NULL unless count is zero.
+ *
+ * @return the number of phrases that were decoded successfully.
+ */
+POLYSEED_API
+size_t polyseed_decode_batch(const char* buffer, const size_t* offsets,
+    size_t count, polyseed_coin coin, polyseed_status* status_out,
+    const polyseed_lang** lang_out, polyseed_storage* storage_out);
+
 /**
  * Decodes the seed from a mnemonic phrase with a specific language.
  * This should be used if polyseed_decode returns POLYSEED_ERR_MULT_LANG.
@@ -295,6 +606,44 @@ POLYSEED_API
 polyseed_status polyseed_decode_explicit(const char* str, polyseed_coin coin,
     const polyseed_lang* lang, polyseed_data** seed_out);
 
+/**
+ * Decodes the seed from a mnemonic phrase with a specific language.
+ * Same as polyseed_decode_explicit, but the phrase is not null-terminated.
+ *
+ * @param str is the mnemonic phrase. Must not be NULL.
+ * @param length is the length of the phrase in bytes. The phrase ends
+ *        earlier if it contains a null character.
+ * @param coin is the coin the mnemonic phrase is intended for.
+ * @param lang is a pointer to the language to decode the seed.
+ *        Must not be NULL.
+ * @param seed_out is a pointer where the seed pointer will be stored.
+ *        Must not be NULL.
+ *
+ * @return POLYSEED_OK if the operation was successful. Other values indicate
+ *         an error (in that case, *seed_out is undefined).
+ */
+POLYSEED_API
+polyseed_status polyseed_decode_explicit_n(const char* str, size_t length,
+    polyseed_coin coin, const polyseed_lang* lang, polyseed_data** seed_out);
+
+/**
+ * Decodes the seed from a mnemonic phrase with a specific language into
+ * caller-provided memory.
+ *
+ * @param str is the mnemonic phrase as a C-style string. Must not be NULL.
+ * @param coin is the coin the mnemonic phrase is intended for.
+ * @param lang is a pointer to the language to decode the seed.
+ *        Must not be NULL.
+ * @param seed is a pointer to memory of at least polyseed_data_size() bytes
+ *        aligned to polyseed_data_align() bytes. Must not be NULL.
+ *
+ * @return POLYSEED_OK if the operation was successful. Other values indicate
+ *         an error (in that case, *seed is not modified).
+ */
+POLYSEED_API
+polyseed_status polyseed_decode_explicit_into(const char* str,
+    polyseed_coin coin, const polyseed_lang* lang, polyseed_data* seed);
+
 /**
  * Serializes the seed data in a platform-independent way.
  *
@@ -320,6 +669,21 @@ POLYSEED_API
 polyseed_status polyseed_load(const polyseed_storage storage,
     polyseed_data** seed_out);
 
+/**
+ * Loads a serialized seed into caller-provided memory.
+ *
+ * @param storage is the buffer with the serialized seed.
+ *        Must not be NULL.
+ * @param seed is a pointer to memory of at least polyseed_data_size() bytes
+ *        aligned to polyseed_data_align() bytes. Must not be NULL.
+ *
+ * @return POLYSEED_OK if the operation was successful. Other values indicate
+ *         an error (in that case, *seed is not modified).
+ */
+POLYSEED_API
+polyseed_status polyseed_load_into(const polyseed_storage storage,
+    polyseed_data* seed);
+
 /**
  * Encrypts or decrypts the seed data with a password.
  *
@@ -329,6 +693,106 @@ polyseed_status polyseed_load(const polyseed_storage storage,
 POLYSEED_API
 void polyseed_crypt(polyseed_data* seed, const char* password);
 
+/**
+ * Encrypts or decrypts the seed data with a password that is not
+ * null-terminated. Same as polyseed_crypt.
+ *
+ * @param seed is the pointer to the seed data. Must not be NULL.
+ * @param password is a user-provided password in UTF8. Must not be NULL.
+ * @param length is the length of the password in bytes. The password ends
+ *        earlier if it contains a null character.
+ */
+POLYSEED_API
+void polyseed_crypt_n(polyseed_data* seed, const char* password,
+    size_t length);
+
+/**
+ * Derives the encryption mask of a password. The mask depends only on the
+ * password, so it can be used to encrypt or decrypt any number of seeds
+ * with polyseed_crypt_with_mask without recalculating PBKDF2.
+ *
+ * @param password is the password of length bytes. Must not be NULL.
+ *        The password ends earlier if it contains a null character.
+ * @param length is the length of the password.
+ * @param mask_out is a pointer where the mask pointer will be stored.
+ *        Must not be NULL.
+ *
+ * @return POLYSEED_OK if the operation was successful.
+ *         POLYSEED_ERR_MEMORY if memory allocation fails.
+*/
+POLYSEED_API
+polyseed_status polyseed_mask_derive(const char* password, size_t length,
+    polyseed_mask** mask_out);
+
+/**
+ * Securely erases the mask and releases the allocated memory.
+ *
+ * @param mask is the pointer to be freed. If NULL, no action is performed.
+*/
+POLYSEED_API
+void polyseed_mask_free(polyseed_mask* mask);
+
+/**
+ * Encrypts or decrypts the seed with a mask derived by polyseed_mask_derive.
+ * The result is the same as calling polyseed_crypt with the password.
+ *
+ * @param seed is a pointer to the seed data. Must not be NULL.
+ * @param mask is a pointer to the mask. Must not be NULL.
+*/
+POLYSEED_API
+void polyseed_crypt_with_mask(polyseed_data* seed, const polyseed_mask* mask);
+
+/**
+ * Encrypts or decrypts a batch of seeds with the same mask.
+ *
+ * @param seeds is an array of count pointers to the seed data.
+ *        Must not be NULL unless count is zero.
+ * @param count is the number of seeds.
+ * @param mask is a pointer to the mask. Must not be NULL.
+*/
+POLYSEED_API
+void polyseed_crypt_batch_with_mask(polyseed_data* const* seeds, size_t count,
+    const polyseed_mask* mask);
+
+/**
+ * Changes the password of encrypted serialized seeds. Each record is
+ * decrypted with the old mask and encrypted with the new mask without
+ * memory allocations per seed. Large batches are split among the worker
+ * threads of the asynchronous operations.
+ *
+ * The rotation is resumable: records are processed from *cursor to count
+ * and the rotated records are written to records_out, which may be the
+ * same array as records. Only the records before the cursor are written,
+ * so a failed rotation can be resumed in place from the returned cursor
+ * after the failing record has been fixed or skipped. A large vault can be
+ * rotated in steps by passing a count smaller than the number of records.
+ *
+ * @param old_mask is the mask of the current password. Must not be NULL.
+ * @param new_mask is the mask of the new password. Must not be NULL.
+ * @param records is an array of at least count serialized seeds.
+ *        Must not be NULL unless count is zero.
+ * @param records_out is an array of at least count elements where the
+ *        rotated seeds will be stored. Must not be NULL unless count is zero.
+ * @param count is the end of the range of records to rotate.
+ * @param cursor is a pointer to the index of the first record to rotate.
+ *        It will be set to count if all records were rotated, otherwise to
+ *        the index of the first record that failed. Elements of records_out
+ *        at and after the cursor are not modified. Must not be NULL.
+ *
+ * @return POLYSEED_OK if all records were rotated.
+ *         POLYSEED_ERR_NOT_ENCRYPTED if the record at the cursor is not
+ *         encrypted.
+ *         POLYSEED_ERR_FORMAT if the record at the cursor has an invalid
+ *         format.
+ *         POLYSEED_ERR_CHECKSUM if the record at the cursor is corrupted.
+ *         POLYSEED_ERR_UNSUPPORTED if the record at the cursor has features
+ *         that have not been enabled.
+*/
+POLYSEED_API
+polyseed_status polyseed_rotate(const polyseed_mask* old_mask,
+    const polyseed_mask* new_mask, const polyseed_storage* records,
+    polyseed_storage* records_out, size_t count, size_t* cursor);
+
 /**
  * Determine if the seed contents are encrypted. The seed is considered
  * encrypted if the polyseed_crypt function has been applied to it
@@ -341,6 +805,313 @@ void polyseed_crypt(polyseed_data* seed, const char* password);
 POLYSEED_API
 int polyseed_is_encrypted(const polyseed_data* seed);
 
+/*
+ * Asynchronous operations
+ *
+ * polyseed_keygen and polyseed_crypt take several milliseconds. The _async
+ * variants queue the operation on a pool of worker threads owned by the
+ * library and return immediately. The pool has one worker per CPU and is
+ * started on first use. Idle workers steal queued jobs from the other
+ * workers. Jobs are allocated by the library and do not use the alloc
+ * dependency. Password copies are stored in locked memory pages where the
+ * platform supports it. The seed, the output buffer and the context must
+ * remain valid until the operation is done. The pool must not be used in
+ * a child process created by fork after it has been used by the parent.
+ */
+
+/**
+ * Derives a secret key from the mnemonic seed asynchronously.
+ * See polyseed_keygen.
+ *
+ * @param seed is a pointer to the seed data. Must not be NULL.
+ * @param coin is the coin the secret key is intended for.
+ * @param key_size is the required key size.
+ * @param key_out is the buffer where the secret key will be stored.
+ *        Must not be NULL.
+ * @param callback is an optional function that is called from a worker
+ *        thread when the operation is done, or from the thread that
+ *        canceled the operation. May be NULL.
+ * @param userdata is passed to the callback.
+ * @param job_out is an optional pointer where the handle of the operation
+ *        will be stored. The handle must be released with polyseed_job_free.
+ *        May be NULL.
+ *
+ * @return POLYSEED_OK if the operation was queued.
+ *         POLYSEED_ERR_MEMORY if memory allocation fails, the worker threads
+ *         cannot be started or the queues are full.
+*/
+POLYSEED_API
+polyseed_status polyseed_keygen_async(const polyseed_data* seed,
+    polyseed_coin coin, size_t key_size, uint8_t* key_out,
+    polyseed_callback* callback, void* userdata, polyseed_job** job_out);
+
+/**
+ * Encrypts or decrypts the seed asynchronously. See polyseed_crypt_n.
+ * The password is copied, so it can be erased right after the call.
+ *
+ * @param seed is a pointer to the seed data. Must not be NULL.
+ * @param password is the password of length bytes. Must not be NULL unless
+ *        length is zero.
+ * @param length is the length of the password.
+ * @param callback is an optional completion callback (see
+ *        polyseed_keygen_async).
+ * @param userdata is passed to the callback.
+ * @param job_out is an optional pointer where the handle of the operation
+ *        will be stored.
+ *
+ * @return POLYSEED_OK if the operation was queued.
+ *         POLYSEED_ERR_MEMORY if memory allocation fails, the worker threads
+ *         cannot be started or the queues are full.
+*/
+POLYSEED_API
+polyseed_status polyseed_crypt_async(polyseed_data* seed,
+    const char* password, size_t length, polyseed_callback* callback,
+    void* userdata, polyseed_job** job_out);
+
+/**
+ * @param job is the handle of an asynchronous operation. Must not be NULL.
+ *
+ * @return 1 if the operation is done (including the completion callback),
+ *         0 otherwise.
+*/
+POLYSEED_API
+int polyseed_job_done(polyseed_job* job);
+
+/**
+ * Waits until an asynchronous operation is done. Must not be called from
+ * the completion callback.
+ *
+ * @param job is the handle of an asynchronous operation. Must not be NULL.
+ *
+ * @return POLYSEED_OK if the operation was completed.
+ *         POLYSEED_ERR_CANCELED if the operation was canceled.
+*/
+POLYSEED_API
+polyseed_status polyseed_job_wait(polyseed_job* job);
+
+/**
+ * Cancels an asynchronous operation that has not started yet. The
+ * completion callback is called with POLYSEED_ERR_CANCELED from the
+ * calling thread.
+ *
+ * @param job is the handle of an asynchronous operation. Must not be NULL.
+ *
+ * @return 1 if the operation was canceled, 0 if it has already started.
+*/
+POLYSEED_API
+int polyseed_job_cancel(polyseed_job* job);
+
+/**
+ * Releases the handle of an asynchronous operation. The operation is
+ * canceled if it has not started yet, otherwise the function waits until
+ * it is done. Must not be called from the completion callback.
+ *
+ * @param job is the handle to be released. If NULL, no action is performed.
+*/
+POLYSEED_API
+void polyseed_job_free(polyseed_job* job);
+
+/*
+ * Contexts
+ *
+ * The functions above use a default context that is configured by
+ * polyseed_inject and polyseed_enable_features. A context created by
+ * polyseed_context_create has its own dependencies and enabled features
+ * and is not modified by the _ctx functions, so it can be used by multiple
+ * threads at the same time. Seeds allocated with a context must be freed
+ * with polyseed_free_ctx and the same context. Builds without malloc can
+ * store a context in caller-provided memory with polyseed_context_init.
+ */
+
+/**
+ * Creates a new context. All seed features are disabled.
+ *
+ * @param deps is a pointer to the structure with dependencies. May point to
+ *        a temporary variable (the struct gets copied internally).
+ *        Must not be NULL.
+ * @param ctx_out is a pointer where the context pointer will be stored.
+ *        Must not be NULL.
+ *
+ * @return POLYSEED_OK if the operation was successful.
+ *         POLYSEED_ERR_MEMORY if memory allocation fails.
+ */
+POLYSEED_API
+polyseed_status polyseed_context_create(const polyseed_dependency* deps,
+    polyseed_context** ctx_out);
+
+/**
+ * Releases a context created by polyseed_context_create.
+ *
+ * @param ctx is the pointer to be freed. If NULL, no action is performed.
+ */
+POLYSEED_API
+void polyseed_context_free(polyseed_context* ctx);
+
+/**
+ * @return the size of a context in bytes. Can be used to provide memory
+ *         for polyseed_context_init.
+ */
+POLYSEED_API
+size_t polyseed_context_size(void);
+
+/**
+ * @return the required alignment of a context in bytes.
+ */
+POLYSEED_API
+size_t polyseed_context_align(void);
+
+/**
+ * Creates a new context in caller-provided memory. The context is the same
+ * as a context created by polyseed_context_create, but no memory is
+ * allocated, so it can be used in builds without malloc. The context must
+ * not be passed to polyseed_context_free. The memory can be released or
+ * reused when the context is no longer used.
+ *
+ * @param ptr is a pointer to memory aligned to polyseed_context_align()
+ *        bytes. Must not be NULL.
+ * @param size is the size of the memory. Should be at least
+ *        polyseed_context_size() bytes.
+ * @param deps is a pointer to the structure with dependencies. May point to
+ *        a temporary variable (the struct gets copied internally).
+ *        Must not be NULL.
+ * @param ctx_out is a pointer where the context pointer will be stored.
+ *        Must not be NULL.
+ *
+ * @return POLYSEED_OK if the operation was successful.
+ *         POLYSEED_ERR_MEMORY if size is smaller than polyseed_context_size().
+ */
+POLYSEED_API
+polyseed_status polyseed_context_init(void* ptr, size_t size,
+    const polyseed_dependency* deps, polyseed_context** ctx_out);
+
+/**
+ * Same as polyseed_enable_features for a context. Must not be called while
+ * the context is used by another thread.
+ */
+POLYSEED_API
+int polyseed_enable_features_ctx(polyseed_context* ctx, unsigned mask);
+
+/**
+ * Same as polyseed_enable_entropy_pool for a context. Must not be called
+ * while the context is used by another thread.
+ */
+POLYSEED_API
+void polyseed_enable_entropy_pool_ctx(polyseed_context* ctx, int enable);
+
+/**
+ * Same as polyseed_enable_keygen_cache for a context. Must not be called
+ * while the context is used by another thread. The cache is shared by
+ * all contexts.
+ */
+POLYSEED_API
+void polyseed_enable_keygen_cache_ctx(polyseed_context* ctx, int enable);
+
+/* Same as the corresponding functions without _ctx with a context. */
+POLYSEED_API
+polyseed_status polyseed_create_ctx(const polyseed_context* ctx,
+    unsigned features, polyseed_data** seed_out);
+POLYSEED_API
+polyseed_status polyseed_create_into_ctx(const polyseed_context* ctx,
+    unsigned features, polyseed_data* seed);
+POLYSEED_API
+polyseed_status polyseed_create_batch_ctx(const polyseed_context* ctx,
+    unsigned features, size_t count, polyseed_storage* storage_out);
+POLYSEED_API
+void polyseed_free_ctx(const polyseed_context* ctx, polyseed_data* seed);
+POLYSEED_API
+void polyseed_erase_ctx(const polyseed_context* ctx, polyseed_data* seed);
+POLYSEED_API
+void polyseed_keygen_ctx(const polyseed_context* ctx,
+    const polyseed_data* seed, polyseed_coin coin, size_t key_size,
+    uint8_t* key_out);
+POLYSEED_API
+void polyseed_keygen_batch_ctx(const polyseed_context* ctx,
+    const polyseed_data* const* seeds, const polyseed_coin* coins,
+    size_t count, size_t key_size, uint8_t* keys_out);
+POLYSEED_API
+void polyseed_keygen_multi_ctx(const polyseed_context* ctx,
+    const polyseed_data* seed, const polyseed_coin* coins, size_t count,
+    size_t key_size, uint8_t* keys_out);
+POLYSEED_API
+size_t polyseed_encode_ctx(const polyseed_context* ctx,
+    const polyseed_data* seed, const polyseed_lang* lang, polyseed_coin coin,
+    polyseed_str str_out);
+POLYSEED_API
+size_t polyseed_encode_batch_ctx(const polyseed_context* ctx,
+    const polyseed_storage* storage, size_t count, const polyseed_lang* lang,
+    polyseed_coin coin, char* buffer, size_t buffer_size, size_t* offsets_out,
+    polyseed_status* status_out);
+POLYSEED_API
+polyseed_status polyseed_decode_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang** lang_out,
+    polyseed_data** seed_out);
+POLYSEED_API
+polyseed_status polyseed_decode_n_ctx(const polyseed_context* ctx,
+    const char* str, size_t length, polyseed_coin coin,
+    const polyseed_lang** lang_out, polyseed_data** seed_out);
+POLYSEED_API
+polyseed_status polyseed_decode_into_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang** lang_out,
+    polyseed_data* seed);
+POLYSEED_API
+polyseed_status polyseed_decode_storage_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang** lang_out,
+    polyseed_storage storage);
+POLYSEED_API
+size_t polyseed_decode_batch_ctx(const polyseed_context* ctx,
+    const char* buffer, const size_t* offsets, size_t count,
+    polyseed_coin coin, polyseed_status* status_out,
+    const polyseed_lang** lang_out, polyseed_storage* storage_out);
+POLYSEED_API
+polyseed_status polyseed_decode_explicit_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang* lang,
+    polyseed_data** seed_out);
+POLYSEED_API
+polyseed_status polyseed_decode_explicit_n_ctx(const polyseed_context* ctx,
+    const char* str, size_t length, polyseed_coin coin,
+    const polyseed_lang* lang, polyseed_data** seed_out);
+POLYSEED_API
+polyseed_status polyseed_decode_explicit_into_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang* lang,
+    polyseed_data* seed);
+POLYSEED_API
+polyseed_status polyseed_load_ctx(const polyseed_context* ctx,
+    const polyseed_storage storage, polyseed_data** seed_out);
+POLYSEED_API
+polyseed_status polyseed_load_into_ctx(const polyseed_context* ctx,
+    const polyseed_storage storage, polyseed_data* seed);
+POLYSEED_API
+void polyseed_crypt_ctx(const polyseed_context* ctx, polyseed_data* seed,
+    const char* password);
+POLYSEED_API
+void polyseed_crypt_n_ctx(const polyseed_context* ctx, polyseed_data* seed,
+    const char* password, size_t length);
+POLYSEED_API
+polyseed_status polyseed_mask_derive_ctx(const polyseed_context* ctx,
+    const char* password, size_t length, polyseed_mask** mask_out);
+POLYSEED_API
+void polyseed_mask_free_ctx(const polyseed_context* ctx, polyseed_mask* mask);
+POLYSEED_API
+void polyseed_crypt_with_mask_ctx(const polyseed_context* ctx,
+    polyseed_data* seed, const polyseed_mask* mask);
+POLYSEED_API
+void polyseed_crypt_batch_with_mask_ctx(const polyseed_context* ctx,
+    polyseed_data* const* seeds, size_t count, const polyseed_mask* mask);
+POLYSEED_API
+polyseed_status polyseed_rotate_ctx(const polyseed_context* ctx,
+    const polyseed_mask* old_mask, const polyseed_mask* new_mask,
+    const polyseed_storage* records, polyseed_storage* records_out,
+    size_t count, size_t* cursor);
+POLYSEED_API
+polyseed_status polyseed_keygen_async_ctx(const polyseed_context* ctx,
+    const polyseed_data* seed, polyseed_coin coin, size_t key_size,
+    uint8_t* key_out, polyseed_callback* callback, void* userdata,
+    polyseed_job** job_out);
+POLYSEED_API
+polyseed_status polyseed_crypt_async_ctx(const polyseed_context* ctx,
+    polyseed_data* seed, const char* password, size_t length,
+    polyseed_callback* callback, void* userdata, polyseed_job** job_out);
+
 #ifdef __cplusplus
 }
 #endif
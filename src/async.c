@@ -0,0 +1,489 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE /* sysconf(_SC_NPROCESSORS_ONLN) */
+#endif
+
+#include "polyseed.h"
+#include "async.h"
+#include "dependency.h"
+#include "storage.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+typedef SRWLOCK async_mutex;
+typedef CONDITION_VARIABLE async_cond;
+
+#define ASYNC_MUTEX_INIT SRWLOCK_INIT
+#define ASYNC_COND_INIT CONDITION_VARIABLE_INIT
+#define mutex_init(m) InitializeSRWLock(m)
+#define mutex_lock(m) AcquireSRWLockExclusive(m)
+#define mutex_unlock(m) ReleaseSRWLockExclusive(m)
+#define cond_wait(c, m) SleepConditionVariableSRW((c), (m), INFINITE, 0)
+#define cond_signal(c) WakeConditionVariable(c)
+#define cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_mutex_t async_mutex;
+typedef pthread_cond_t async_cond;
+
+#define ASYNC_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+#define ASYNC_COND_INIT PTHREAD_COND_INITIALIZER
+#define mutex_init(m) pthread_mutex_init((m), NULL)
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define cond_wait(c, m) pthread_cond_wait((c), (m))
+#define cond_signal(c) pthread_cond_signal(c)
+#define cond_broadcast(c) pthread_cond_broadcast(c)
+#endif
+
+/* The pool has one worker per CPU (up to ASYNC_MAX_WORKERS). Each worker
+   has a bounded queue of ASYNC_QUEUE_SIZE jobs. Workers take jobs from the
+   front of their own queue and steal from the back of the other queues
+   when their queue is empty. */
+#define ASYNC_MAX_WORKERS 64
+#define ASYNC_QUEUE_SIZE 256
+
+enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
+enum {
+    JOB_KEYGEN,
+    JOB_CRYPT,
+    JOB_FUNC,
+};
+
+struct polyseed_job {
+    const polyseed_context* ctx;
+    int type;
+    polyseed_data* seed;
+    polyseed_coin coin;
+    size_t key_size;
+    uint8_t* key_out;
+    /* copy of the password (JOB_CRYPT) */
+    char* password;
+    size_t password_length;
+    bool password_pages;
+    /* internal function (JOB_FUNC) */
+    polyseed_async_func* func;
+    void* arg;
+    polyseed_callback* callback;
+    void* userdata;
+    polyseed_status status;
+    atomic_int state;
+    /* the queue and the handle returned to the caller */
+    atomic_int refs;
+    /* the last reference may be released after the context is freed */
+    polyseed_memzero* memzero;
+};
+
+typedef struct job_queue {
+    async_mutex lock;
+    size_t head;
+    size_t count;
+    polyseed_job* jobs[ASYNC_QUEUE_SIZE];
+} job_queue;
+
+static job_queue g_queues[ASYNC_MAX_WORKERS];
+static unsigned g_num_workers;
+static atomic_uint g_next_queue;
+
+/* protects the pool startup, idle workers wait on g_work_cond */
+static async_mutex g_pool_lock = ASYNC_MUTEX_INIT;
+static async_cond g_work_cond = ASYNC_COND_INIT;
+/* number of jobs in all queues, updated with the queue lock held */
+static atomic_size_t g_num_queued;
+
+/* signaled when any job is done */
+static async_mutex g_done_lock = ASYNC_MUTEX_INIT;
+static async_cond g_done_cond = ASYNC_COND_INIT;
+
+/* The password is copied to locked pages, or to the heap on platforms
+   without virtual memory. */
+static bool password_copy(polyseed_job* job, const char* password,
+    size_t length) {
+    char* copy = polyseed_secure_pages(length + 1);
+    job->password_pages = copy != NULL;
+    if (copy == NULL) {
+        copy = malloc(length + 1);
+        if (copy == NULL) {
+            return false;
+        }
+    }
+    if (length > 0) {
+        memcpy(copy, password, length);
+    }
+    copy[length] = '\0';
+    job->password = copy;
+    job->password_length = length;
+    return true;
+}
+
+static void password_free(polyseed_job* job) {
+    if (job->password == NULL) {
+        return;
+    }
+    job->memzero(job->password, job->password_length + 1);
+    if (job->password_pages) {
+        polyseed_secure_pages_free(job->password, job->password_length + 1);
+    }
+    else {
+        free(job->password);
+    }
+    job->password = NULL;
+}
+
+static void job_release(polyseed_job* job) {
+    if (atomic_fetch_sub_explicit(&job->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    password_free(job);
+    free(job);
+}
+
+/* Job records are allocated with malloc, because the alloc dependency
+   may only support seed-sized blocks, like polyseed_secure_alloc. */
+static polyseed_job* job_create(const polyseed_context* ctx, int type) {
+    polyseed_job* job = malloc(sizeof(polyseed_job));
+    if (job == NULL) {
+        return NULL;
+    }
+    memset(job, 0, sizeof(polyseed_job));
+    job->ctx = ctx;
+    job->type = type;
+    job->memzero = ctx->deps.memzero;
+    return job;
+}
+
+static void job_complete(polyseed_job* job, polyseed_status status) {
+    job->status = status;
+    if (job->callback != NULL) {
+        job->callback(job, status, job->userdata);
+    }
+    mutex_lock(&g_done_lock);
+    atomic_store_explicit(&job->state, JOB_DONE, memory_order_release);
+    cond_broadcast(&g_done_cond);
+    mutex_unlock(&g_done_lock);
+}
+
+static void job_run(polyseed_job* job) {
+    int queued = JOB_QUEUED;
+    if (!atomic_compare_exchange_strong(&job->state, &queued, JOB_RUNNING)) {
+        return; /* canceled */
+    }
+    switch (job->type) {
+    case JOB_KEYGEN:
+        polyseed_keygen_ctx(job->ctx, job->seed, job->coin, job->key_size,
+            job->key_out);
+        break;
+    case JOB_CRYPT:
+        polyseed_crypt_n_ctx(job->ctx, job->seed, job->password,
+            job->password_length);
+        break;
+    case JOB_FUNC:
+        job->func(job->arg);
+        break;
+    }
+    job_complete(job, POLYSEED_OK);
+}
+
+static bool queue_push(job_queue* queue, polyseed_job* job) {
+    bool pushed = false;
+    mutex_lock(&queue->lock);
+    if (queue->count < ASYNC_QUEUE_SIZE) {
+        queue->jobs[(queue->head + queue->count) % ASYNC_QUEUE_SIZE] = job;
+        queue->count++;
+        atomic_fetch_add_explicit(&g_num_queued, 1, memory_order_relaxed);
+        pushed = true;
+    }
+    mutex_unlock(&queue->lock);
+    return pushed;
+}
+
+static polyseed_job* queue_pop(job_queue* queue, bool steal) {
+    polyseed_job* job = NULL;
+    mutex_lock(&queue->lock);
+    if (queue->count > 0) {
+        queue->count--;
+        atomic_fetch_sub_explicit(&g_num_queued, 1, memory_order_relaxed);
+        if (steal) {
+            job = queue->jobs[(queue->head + queue->count) % ASYNC_QUEUE_SIZE];
+        }
+        else {
+            job = queue->jobs[queue->head];
+            queue->head = (queue->head + 1) % ASYNC_QUEUE_SIZE;
+        }
+    }
+    mutex_unlock(&queue->lock);
+    return job;
+}
+
+static polyseed_job* take_job(unsigned worker) {
+    polyseed_job* job = queue_pop(&g_queues[worker], false);
+    for (unsigned i = 1; job == NULL && i < g_num_workers; ++i) {
+        job = queue_pop(&g_queues[(worker + i) % g_num_workers], true);
+    }
+    return job;
+}
+
+static void worker_loop(unsigned worker) {
+    for (;;) {
+        polyseed_job* job = take_job(worker);
+        if (job == NULL) {
+            /* sleep until a job is queued */
+            mutex_lock(&g_pool_lock);
+            while (atomic_load_explicit(&g_num_queued,
+                memory_order_relaxed) == 0) {
+                cond_wait(&g_work_cond, &g_pool_lock);
+            }
+            mutex_unlock(&g_pool_lock);
+            continue;
+        }
+        job_run(job);
+        job_release(job);
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI worker_main(LPVOID arg) {
+    worker_loop((unsigned)(uintptr_t)arg);
+    return 0;
+}
+
+static unsigned num_cpus(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+}
+
+static bool start_worker(unsigned worker) {
+    HANDLE thread = CreateThread(NULL, 0, &worker_main,
+        (LPVOID)(uintptr_t)worker, 0, NULL);
+    if (thread == NULL) {
+        return false;
+    }
+    CloseHandle(thread);
+    return true;
+}
+#else
+static void* worker_main(void* arg) {
+    worker_loop((unsigned)(uintptr_t)arg);
+    return NULL;
+}
+
+static unsigned num_cpus(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+}
+
+static bool start_worker(unsigned worker) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &worker_main,
+        (void*)(uintptr_t)worker) != 0) {
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+#endif
+
+/* Starts the workers on first use. Must be called with g_pool_lock held.
+   Returns false if no worker could be started. */
+static bool pool_start(void) {
+    if (g_num_workers > 0) {
+        return true;
+    }
+    unsigned num_workers = num_cpus();
+    if (num_workers > ASYNC_MAX_WORKERS) {
+        num_workers = ASYNC_MAX_WORKERS;
+    }
+    for (unsigned i = 0; i < num_workers; ++i) {
+        mutex_init(&g_queues[i].lock);
+    }
+    /* workers only read g_num_workers after they are woken up */
+    g_num_workers = num_workers;
+    unsigned started = 0;
+    while (started < num_workers && start_worker(started)) {
+        started++;
+    }
+    if (started == 0) {
+        g_num_workers = 0;
+        return false;
+    }
+    /* jobs in the queues of workers that failed to start are stolen */
+    return true;
+}
+
+static polyseed_status job_submit(polyseed_job* job, polyseed_job** job_out) {
+    atomic_init(&job->state, JOB_QUEUED);
+    atomic_init(&job->refs, job_out != NULL ? 2 : 1);
+
+    mutex_lock(&g_pool_lock);
+    bool started = pool_start();
+    mutex_unlock(&g_pool_lock);
+    if (!started) {
+        return POLYSEED_ERR_MEMORY;
+    }
+
+    unsigned first = atomic_fetch_add_explicit(&g_next_queue, 1,
+        memory_order_relaxed);
+    bool pushed = false;
+    for (unsigned i = 0; !pushed && i < g_num_workers; ++i) {
+        pushed = queue_push(&g_queues[(first + i) % g_num_workers], job);
+    }
+    if (!pushed) {
+        return POLYSEED_ERR_MEMORY;
+    }
+
+    if (job_out != NULL) {
+        *job_out = job;
+    }
+    /* a worker checks the number of queued jobs with the lock held
+       before it waits, so the signal can't be lost */
+    mutex_lock(&g_pool_lock);
+    cond_signal(&g_work_cond);
+    mutex_unlock(&g_pool_lock);
+    return POLYSEED_OK;
+}
+
+polyseed_status polyseed_keygen_async(const polyseed_data* seed,
+    polyseed_coin coin, size_t key_size, uint8_t* key_out,
+    polyseed_callback* callback, void* userdata, polyseed_job** job_out) {
+    return polyseed_keygen_async_ctx(&polyseed_default_ctx, seed, coin,
+        key_size, key_out, callback, userdata, job_out);
+}
+
+polyseed_status polyseed_keygen_async_ctx(const polyseed_context* ctx,
+    const polyseed_data* seed, polyseed_coin coin, size_t key_size,
+    uint8_t* key_out, polyseed_callback* callback, void* userdata,
+    polyseed_job** job_out) {
+
+    assert(ctx != NULL);
+    assert(seed != NULL);
+    assert(key_out != NULL);
+    CHECK_DEPS(ctx);
+
+    polyseed_job* job = job_create(ctx, JOB_KEYGEN);
+    if (job == NULL) {
+        return POLYSEED_ERR_MEMORY;
+    }
+    /* the seed is only read */
+    job->seed = (polyseed_data*)seed;
+    job->coin = coin;
+    job->key_size = key_size;
+    job->key_out = key_out;
+    job->callback = callback;
+    job->userdata = userdata;
+
+    polyseed_status res = job_submit(job, job_out);
+    if (res != POLYSEED_OK) {
+        free(job);
+    }
+    return res;
+}
+
+polyseed_status polyseed_crypt_async(polyseed_data* seed,
+    const char* password, size_t length, polyseed_callback* callback,
+    void* userdata, polyseed_job** job_out) {
+    return polyseed_crypt_async_ctx(&polyseed_default_ctx, seed, password,
+        length, callback, userdata, job_out);
+}
+
+polyseed_status polyseed_crypt_async_ctx(const polyseed_context* ctx,
+    polyseed_data* seed, const char* password, size_t length,
+    polyseed_callback* callback, void* userdata, polyseed_job** job_out) {
+
+    assert(ctx != NULL);
+    assert(seed != NULL);
+    assert(password != NULL || length == 0);
+    CHECK_DEPS(ctx);
+
+    polyseed_job* job = job_create(ctx, JOB_CRYPT);
+    if (job == NULL) {
+        return POLYSEED_ERR_MEMORY;
+    }
+    /* the password is copied, so the caller can erase it right away */
+    if (!password_copy(job, password, length)) {
+        free(job);
+        return POLYSEED_ERR_MEMORY;
+    }
+    job->seed = seed;
+    job->callback = callback;
+    job->userdata = userdata;
+
+    polyseed_status res = job_submit(job, job_out);
+    if (res != POLYSEED_OK) {
+        password_free(job);
+        free(job);
+    }
+    return res;
+}
+
+POLYSEED_PRIVATE polyseed_status polyseed_async_run(
+    const polyseed_context* ctx, polyseed_async_func* func, void* arg,
+    polyseed_job** job_out) {
+
+    assert(ctx != NULL);
+    assert(func != NULL);
+
+    polyseed_job* job = job_create(ctx, JOB_FUNC);
+    if (job == NULL) {
+        return POLYSEED_ERR_MEMORY;
+    }
+    job->func = func;
+    job->arg = arg;
+
+    polyseed_status res = job_submit(job, job_out);
+    if (res != POLYSEED_OK) {
+        free(job);
+    }
+    return res;
+}
+
+int polyseed_job_done(polyseed_job* job) {
+    assert(job != NULL);
+    return atomic_load_explicit(&job->state, memory_order_acquire) == JOB_DONE;
+}
+
+polyseed_status polyseed_job_wait(polyseed_job* job) {
+    assert(job != NULL);
+    mutex_lock(&g_done_lock);
+    while (atomic_load_explicit(&job->state, memory_order_acquire) != JOB_DONE) {
+        cond_wait(&g_done_cond, &g_done_lock);
+    }
+    mutex_unlock(&g_done_lock);
+    return job->status;
+}
+
+int polyseed_job_cancel(polyseed_job* job) {
+    assert(job != NULL);
+    int queued = JOB_QUEUED;
+    if (!atomic_compare_exchange_strong(&job->state, &queued, JOB_RUNNING)) {
+        return 0; /* already started */
+    }
+    /* the worker that takes the job from the queue will skip it */
+    job_complete(job, POLYSEED_ERR_CANCELED);
+    return 1;
+}
+
+void polyseed_job_free(polyseed_job* job) {
+    if (job == NULL) {
+        return;
+    }
+    (void)polyseed_job_cancel(job);
+    (void)polyseed_job_wait(job);
+    job_release(job);
+}
@@ -0,0 +1,17 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include "polyseed.h"
+
+typedef void polyseed_async_func(void* arg);
+
+/* Runs func(arg) on the worker pool. The job handle must be released
+   with polyseed_job_free. */
+POLYSEED_PRIVATE polyseed_status polyseed_async_run(
+    const polyseed_context* ctx, polyseed_async_func* func, void* arg,
+    polyseed_job** job_out);
+
+#endif
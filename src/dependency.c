@@ -3,35 +3,86 @@
 
 #include "polyseed.h"
 #include "dependency.h"
-#include "lang.h"
+#include "features.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 
-POLYSEED_PRIVATE polyseed_dependency polyseed_deps;
+POLYSEED_PRIVATE polyseed_context polyseed_default_ctx = {
+    .reserved_features = FEATURE_RESERVED_DEFAULT,
+};
 
 static uint64_t stdlib_time() {
     return (uint64_t)time(NULL);
 }
 
-void polyseed_inject(const polyseed_dependency* deps) {
-    polyseed_deps = *deps;
-    if (polyseed_deps.time == NULL) {
-        polyseed_deps.time = &stdlib_time;
+static void set_deps(polyseed_context* ctx, const polyseed_dependency* deps) {
+    ctx->deps = *deps;
+    if (ctx->deps.time == NULL) {
+        ctx->deps.time = &stdlib_time;
+    }
+    if (ctx->deps.alloc == NULL) {
+        ctx->deps.alloc = &malloc;
     }
-    if (polyseed_deps.alloc == NULL) {
-        polyseed_deps.alloc = &malloc;
+    if (ctx->deps.free == NULL) {
+        ctx->deps.free = &free;
     }
-    if (polyseed_deps.free == NULL) {
-        polyseed_deps.free = &free;
+    CHECK_DEPS(ctx);
+}
+
+void polyseed_inject(const polyseed_dependency* deps) {
+    set_deps(&polyseed_default_ctx, deps);
+}
+
+static void context_setup(polyseed_context* ctx,
+    const polyseed_dependency* deps) {
+    set_deps(ctx, deps);
+    ctx->reserved_features = FEATURE_RESERVED_DEFAULT;
+    ctx->entropy_pool = false;
+    ctx->keygen_cache = false;
+}
+
+polyseed_status polyseed_context_create(const polyseed_dependency* deps,
+    polyseed_context** ctx_out) {
+    assert(deps != NULL);
+    assert(ctx_out != NULL);
+
+    polyseed_context* ctx = malloc(sizeof(polyseed_context));
+    if (ctx == NULL) {
+        return POLYSEED_ERR_MEMORY;
     }
-    CHECK_DEPS();
+    context_setup(ctx, deps);
 
-    /* self-test */
-#ifndef NDEBUG
-    for (int i = 0; i < polyseed_get_num_langs(); ++i) {
-        const polyseed_lang* lang = polyseed_get_lang(i);
-        polyseed_lang_check(lang);
+    *ctx_out = ctx;
+    return POLYSEED_OK;
+}
+
+size_t polyseed_context_size(void) {
+    return sizeof(polyseed_context);
+}
+
+size_t polyseed_context_align(void) {
+    return _Alignof(polyseed_context);
+}
+
+polyseed_status polyseed_context_init(void* ptr, size_t size,
+    const polyseed_dependency* deps, polyseed_context** ctx_out) {
+    assert(ptr != NULL);
+    assert((uintptr_t)ptr % _Alignof(polyseed_context) == 0);
+    assert(deps != NULL);
+    assert(ctx_out != NULL);
+
+    if (size < sizeof(polyseed_context)) {
+        return POLYSEED_ERR_MEMORY;
     }
-#endif
+    polyseed_context* ctx = ptr;
+    context_setup(ctx, deps);
+
+    *ctx_out = ctx;
+    return POLYSEED_OK;
+}
+
+void polyseed_context_free(polyseed_context* ctx) {
+    free(ctx);
 }
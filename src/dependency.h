@@ -5,48 +5,100 @@
 #define DEPENDENCY_H
 
 #include "polyseed.h"
+#include "storage.h"
+#include "unicode.h"
 
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 
-extern polyseed_dependency polyseed_deps;
-
-#define CHECK_DEPS() do {\
-    assert(polyseed_deps.randbytes != NULL); \
-    assert(polyseed_deps.pbkdf2_sha256 != NULL); \
-    assert(polyseed_deps.memzero != NULL); \
-    assert(polyseed_deps.u8_nfc != NULL); \
-    assert(polyseed_deps.u8_nfkd != NULL); \
-    assert(polyseed_deps.time != NULL); \
-    assert(polyseed_deps.alloc != NULL); \
-    assert(polyseed_deps.free != NULL); } while(false)
-
-/* only normalize strings that contain non-ASCII characters */
-static size_t utf8_nfkd_lazy(const char* str, polyseed_str norm) {
-    size_t size = 0;
-    const char* pos = str;
-    while (*pos != '\0' && size < POLYSEED_STR_SIZE - 1) {
-        if (*pos < 0) { /* non-ASCII */
-            return polyseed_deps.u8_nfkd(str, norm);
+struct polyseed_context {
+    polyseed_dependency deps;
+    /* features that are not enabled */
+    unsigned reserved_features;
+    /* random bytes are requested through the per-thread entropy pool */
+    bool entropy_pool;
+    /* derived keys are cached by polyseed_keygen */
+    bool keygen_cache;
+};
+
+/* Context of the API functions without a context parameter */
+extern polyseed_context polyseed_default_ctx;
+
+#define CHECK_DEPS(ctx) do {\
+    assert((ctx)->deps.randbytes != NULL); \
+    assert((ctx)->deps.pbkdf2_sha256 != NULL); \
+    assert((ctx)->deps.memzero != NULL); \
+    assert((ctx)->deps.u8_nfkd != NULL); \
+    assert((ctx)->deps.time != NULL); \
+    assert((ctx)->deps.alloc != NULL); \
+    assert((ctx)->deps.free != NULL); } while(false)
+
+/* Normalizes a string with the injected function, which expects a C-style
+   string. Input longer than what can produce POLYSEED_STR_SIZE - 1 bytes
+   of normalized output is cut at a character boundary. */
+static inline size_t utf8_nfkd_any(const polyseed_dependency* deps, const char* str,
+    size_t len, polyseed_str norm) {
+    char tmp[4 * POLYSEED_STR_SIZE];
+    if (len > sizeof(tmp) - 1) {
+        len = sizeof(tmp) - 1;
+        while (len > 0 && (str[len] & 0xc0) == 0x80) {
+            --len;
         }
-        norm[size] = *pos;
-        pos++;
-        size++;
     }
-    norm[size] = '\0';
+    memcpy(tmp, str, len);
+    tmp[len] = '\0';
+    size_t size = deps->u8_nfkd(tmp, norm);
+    deps->memzero(tmp, sizeof(tmp));
     return size;
 }
 
-#define GET_RANDOM_BYTES(a, b) polyseed_deps.randbytes((a), (b))
-#define PBKDF2_SHA256(pw, pwlen, salt, saltlen, iter, key, keylen) \
-    polyseed_deps.pbkdf2_sha256((pw), (pwlen), (salt), (saltlen), (iter), \
+/* Validates the string of len bytes and normalizes it with the built-in
+   normalizer. The injected function is called only for strings with
+   unsupported characters. ASCII strings are already normalized and are
+   returned without a copy. Returns NULL for invalid UTF-8. */
+static inline const char* utf8_nfkd_lazy(const polyseed_dependency* deps,
+    const char* str, size_t len, polyseed_str norm, size_t* size_out) {
+    switch (polyseed_utf8_check(str, len)) {
+    case UTF8_INVALID:
+        return NULL;
+    case UTF8_ASCII:
+        if (len > POLYSEED_STR_SIZE - 1) {
+            len = POLYSEED_STR_SIZE - 1;
+        }
+        *size_out = len;
+        return str;
+    default:
+        if (!polyseed_utf8_nfkd(str, len, norm, size_out)) {
+            *size_out = utf8_nfkd_any(deps, str, len, norm);
+        }
+        return norm;
+    }
+}
+
+/* Returns n random bytes from the entropy pool of the calling thread,
+   which is refilled from deps->randbytes in large chunks */
+POLYSEED_PRIVATE void polyseed_entropy_get(const polyseed_dependency* deps,
+    void* result, size_t n);
+
+#define GET_RANDOM_BYTES(ctx, a, b) ((ctx)->entropy_pool ? \
+    polyseed_entropy_get(&(ctx)->deps, (a), (b)) : \
+    (ctx)->deps.randbytes((a), (b)))
+#define PBKDF2_SHA256(ctx, pw, pwlen, salt, saltlen, iter, key, keylen) \
+    (ctx)->deps.pbkdf2_sha256((pw), (pwlen), (salt), (saltlen), (iter), \
     (key), (keylen))
-#define MEMZERO_LOC(x) polyseed_deps.memzero((void*)&(x), sizeof(x))
-#define MEMZERO_PTR(x, type) polyseed_deps.memzero((x), sizeof(type))
-#define UTF8_COMPOSE(a, b) polyseed_deps.u8_nfc((a), (b))
-#define UTF8_DECOMPOSE(a, b) utf8_nfkd_lazy((a), (b))
-#define GET_TIME() polyseed_deps.time()
-#define ALLOC(x) polyseed_deps.alloc(x)
-#define FREE(x) polyseed_deps.free(x)
+#define MEMZERO_LOC(ctx, x) (ctx)->deps.memzero((void*)&(x), sizeof(x))
+#define MEMZERO_PTR(ctx, x, type) (ctx)->deps.memzero((x), sizeof(type))
+#define UTF8_DECOMPOSE(ctx, a, b, c, d) \
+    utf8_nfkd_lazy(&(ctx)->deps, (a), (b), (c), (d))
+#define UTF8_DECOMPOSE_ANY(ctx, a, b, c) \
+    utf8_nfkd_any(&(ctx)->deps, (a), (b), (c))
+#define GET_TIME(ctx) (ctx)->deps.time()
+/* Only seeds and password masks are allocated with the alloc dependency,
+   so allocators with seed-sized blocks like polyseed_secure_alloc work.
+   Other memory is allocated by the library itself. */
+#define ALLOC_MAX_SIZE sizeof(polyseed_data)
+#define ALLOC(ctx, x) (assert((x) <= ALLOC_MAX_SIZE), (ctx)->deps.alloc(x))
+#define FREE(ctx, x) (ctx)->deps.free(x)
 
 #endif
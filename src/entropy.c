@@ -0,0 +1,189 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, madvise */
+#endif
+
+#include "polyseed.h"
+#include "dependency.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#define POOL_PTHREAD
+#include <pthread.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
+#endif
+
+/* Pages that are zeroed in the child process by the kernel on fork */
+#if defined(POOL_PTHREAD) && defined(MADV_WIPEONFORK)
+#define POOL_WIPEONFORK
+#endif
+
+#if defined(_MSC_VER)
+#define POOL_THREAD_LOCAL __declspec(thread)
+#else
+#define POOL_THREAD_LOCAL _Thread_local
+#endif
+
+/* Random bytes are requested from the source in chunks of POOL_SIZE bytes.
+   Larger requests bypass the pool. */
+#define POOL_SIZE 1024
+#define POOL_MAX_REQUEST (POOL_SIZE / 4)
+
+/* An all-zero pool is empty, so a pool wiped on fork is refilled. */
+typedef struct entropy_pool {
+    /* source of the buffered bytes */
+    polyseed_randbytes* source;
+    /* number of unused bytes at the end of the buffer */
+    size_t avail;
+#ifdef POOL_PTHREAD
+    /* process that filled the pool */
+    pid_t pid;
+#endif
+    uint8_t buffer[POOL_SIZE];
+} entropy_pool;
+
+static POOL_THREAD_LOCAL entropy_pool t_pool_static;
+static POOL_THREAD_LOCAL entropy_pool* t_pool;
+#ifdef POOL_WIPEONFORK
+static POOL_THREAD_LOCAL bool t_pool_wipeonfork;
+#endif
+
+static void pool_wipe(volatile uint8_t* buffer, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        buffer[i] = 0;
+    }
+}
+
+/* Discards the unused bytes of the pool */
+static void pool_reset(entropy_pool* pool) {
+    pool_wipe(pool->buffer + POOL_SIZE - pool->avail, pool->avail);
+    pool->avail = 0;
+    pool->source = NULL;
+}
+
+#ifdef POOL_PTHREAD
+static pthread_once_t g_pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_pool_key;
+static bool g_pool_key_valid;
+
+/* Erases the pool of a thread when the thread exits */
+static void pool_destroy(void* arg) {
+    entropy_pool* pool = arg;
+    pool_wipe((volatile uint8_t*)pool, sizeof(entropy_pool));
+#ifdef POOL_WIPEONFORK
+    if (pool != &t_pool_static) {
+        (void)munmap(pool, sizeof(entropy_pool));
+    }
+    t_pool_wipeonfork = false;
+#endif
+    t_pool = NULL;
+}
+
+/* Only the thread that called fork exists in the child process, so
+   resetting its pool is enough to prevent the child from reusing the
+   bytes buffered by the parent. Processes created without running the
+   fork handlers are detected by the pid check in pool_forked. */
+static void pool_atfork_child(void) {
+    if (t_pool != NULL) {
+        pool_reset(t_pool);
+    }
+}
+
+static void pool_init(void) {
+    g_pool_key_valid = pthread_key_create(&g_pool_key, &pool_destroy) == 0;
+    (void)pthread_atfork(NULL, NULL, &pool_atfork_child);
+}
+#endif
+
+/* Returns the pool of the calling thread */
+static entropy_pool* pool_get(void) {
+    if (t_pool != NULL) {
+        return t_pool;
+    }
+    entropy_pool* pool = &t_pool_static;
+#ifdef POOL_PTHREAD
+    (void)pthread_once(&g_pool_once, &pool_init);
+#ifdef POOL_WIPEONFORK
+    /* the mapping is released by pool_destroy */
+    void* mem = g_pool_key_valid ? mmap(NULL, sizeof(entropy_pool),
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) :
+        MAP_FAILED;
+    if (mem != MAP_FAILED) {
+        if (madvise(mem, sizeof(entropy_pool), MADV_WIPEONFORK) == 0) {
+            pool = mem;
+            t_pool_wipeonfork = true;
+        }
+        else {
+            (void)munmap(mem, sizeof(entropy_pool));
+        }
+    }
+#endif
+    if (g_pool_key_valid) {
+        (void)pthread_setspecific(g_pool_key, pool);
+    }
+#endif
+    t_pool = pool;
+    return pool;
+}
+
+/* Returns true if the pool was filled by another process */
+static bool pool_forked(const entropy_pool* pool) {
+#ifdef POOL_WIPEONFORK
+    if (t_pool_wipeonfork) {
+        return false;
+    }
+#endif
+#ifdef POOL_PTHREAD
+    return pool->pid != getpid();
+#else
+    (void)pool;
+    return false;
+#endif
+}
+
+POLYSEED_PRIVATE void polyseed_entropy_get(const polyseed_dependency* deps,
+    void* result, size_t n) {
+    assert(deps->randbytes != NULL);
+
+    if (n > POOL_MAX_REQUEST) {
+        deps->randbytes(result, n);
+        return;
+    }
+    entropy_pool* pool = pool_get();
+    if (pool->source != deps->randbytes || pool_forked(pool)) {
+        pool_reset(pool);
+        pool->source = deps->randbytes;
+#ifdef POOL_PTHREAD
+        pool->pid = getpid();
+#endif
+    }
+    if (pool->avail < n) {
+        pool_wipe(pool->buffer + POOL_SIZE - pool->avail, pool->avail);
+        deps->randbytes(pool->buffer, POOL_SIZE);
+        pool->avail = POOL_SIZE;
+    }
+    /* consumed bytes are erased immediately */
+    uint8_t* pos = pool->buffer + POOL_SIZE - pool->avail;
+    memcpy(result, pos, n);
+    pool_wipe(pos, n);
+    pool->avail -= n;
+}
+
+void polyseed_enable_entropy_pool(int enable) {
+    polyseed_enable_entropy_pool_ctx(&polyseed_default_ctx, enable);
+}
+
+void polyseed_enable_entropy_pool_ctx(polyseed_context* ctx, int enable) {
+    assert(ctx != NULL);
+    ctx->entropy_pool = enable != 0;
+}
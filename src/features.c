@@ -2,17 +2,22 @@
 /* See LICENSE for licensing information */
 
 #include "polyseed.h"
+#include "dependency.h"
 #include "features.h"
 
-static unsigned reserved_features = FEATURE_MASK ^ ENCRYPTED_MASK;
-
-POLYSEED_PRIVATE bool polyseed_features_supported(unsigned features) {
-    return (features & reserved_features) == 0;
+POLYSEED_PRIVATE bool polyseed_features_supported(const polyseed_context* ctx,
+    unsigned features) {
+    return (features & ctx->reserved_features) == 0;
 }
 
 int polyseed_enable_features(unsigned mask) {
+    return polyseed_enable_features_ctx(&polyseed_default_ctx, mask);
+}
+
+int polyseed_enable_features_ctx(polyseed_context* ctx, unsigned mask) {
+    assert(ctx != NULL);
     int num_enabled = 0;
-    reserved_features = FEATURE_MASK ^ ENCRYPTED_MASK;
+    unsigned reserved_features = FEATURE_RESERVED_DEFAULT;
     for (int i = 0; i < USER_FEATURES; ++i) {
         unsigned fmask = 1u << i;
         if (mask & fmask) {
@@ -20,5 +25,6 @@ int polyseed_enable_features(unsigned mask) {
             num_enabled++;
         }
     }
+    ctx->reserved_features = reserved_features;
     return num_enabled;
 }
@@ -16,6 +16,9 @@
 #define USER_FEATURES_MASK ((1<<USER_FEATURES)-1)
 #define ENCRYPTED_MASK 16
 
+/* all user features are disabled by default */
+#define FEATURE_RESERVED_DEFAULT (FEATURE_MASK ^ ENCRYPTED_MASK)
+
 static inline unsigned make_features(unsigned user_features) {
     return user_features & USER_FEATURES_MASK;
 }
@@ -28,6 +31,7 @@ static inline bool is_encrypted(unsigned features) {
     return (features & ENCRYPTED_MASK) != 0;
 }
 
-POLYSEED_PRIVATE bool polyseed_features_supported(unsigned features);
+POLYSEED_PRIVATE bool polyseed_features_supported(const polyseed_context* ctx,
+    unsigned features);
 
 #endif
@@ -0,0 +1,144 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include "polyseed.h"
+#include "dependency.h"
+#include "keycache.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <string.h>
+
+/* The cache has a fixed number of entries that are replaced in
+   round-robin order. Keys are stored in locked memory pages. */
+#define CACHE_ENTRIES 32
+
+typedef struct cache_entry {
+    /* seed instance and the seed data the key was derived from */
+    const polyseed_data* seed;
+    polyseed_data data;
+    /* PBKDF2 function that derived the key */
+    polyseed_pbkdf2* kdf;
+    polyseed_coin coin;
+    /* zero for unused entries */
+    size_t key_size;
+    uint8_t key[KEYCACHE_MAX_KEY_SIZE];
+} cache_entry;
+
+/* used if locked pages are not available */
+static cache_entry g_static_entries[CACHE_ENTRIES];
+
+static cache_entry* g_entries;
+static unsigned g_next_entry;
+static atomic_flag g_lock = ATOMIC_FLAG_INIT;
+/* set when the first key is added to avoid locking in polyseed_free
+   if the cache is not used */
+static atomic_bool g_used;
+
+static void cache_lock(void) {
+    while (atomic_flag_test_and_set_explicit(&g_lock, memory_order_acquire)) {
+    }
+}
+
+static void cache_unlock(void) {
+    atomic_flag_clear_explicit(&g_lock, memory_order_release);
+}
+
+static void entry_wipe(cache_entry* entry) {
+    volatile unsigned char* p = (volatile unsigned char*)entry;
+    for (size_t i = 0; i < sizeof(cache_entry); ++i) {
+        p[i] = 0;
+    }
+}
+
+/* Compares the seed data without leaking the position of a mismatch */
+static bool data_equals(const polyseed_data* a, const polyseed_data* b) {
+    unsigned diff = (a->birthday ^ b->birthday) | (a->features ^ b->features)
+        | (a->checksum ^ b->checksum);
+    for (int i = 0; i < SECRET_BUFFER_SIZE; ++i) {
+        diff |= a->secret[i] ^ b->secret[i];
+    }
+    return diff == 0;
+}
+
+static cache_entry* cache_find(const polyseed_data* seed,
+    polyseed_pbkdf2* kdf, polyseed_coin coin, size_t key_size) {
+    if (g_entries == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < CACHE_ENTRIES; ++i) {
+        cache_entry* entry = &g_entries[i];
+        if (entry->key_size == key_size && entry->seed == seed &&
+            entry->kdf == kdf && entry->coin == coin &&
+            data_equals(&entry->data, seed)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+POLYSEED_PRIVATE bool polyseed_keycache_get(const polyseed_data* seed,
+    polyseed_pbkdf2* kdf, polyseed_coin coin, size_t key_size,
+    uint8_t* key_out) {
+    if (key_size == 0 || key_size > KEYCACHE_MAX_KEY_SIZE) {
+        return false;
+    }
+    cache_lock();
+    cache_entry* entry = cache_find(seed, kdf, coin, key_size);
+    if (entry != NULL) {
+        memcpy(key_out, entry->key, key_size);
+    }
+    cache_unlock();
+    return entry != NULL;
+}
+
+POLYSEED_PRIVATE void polyseed_keycache_put(const polyseed_data* seed,
+    polyseed_pbkdf2* kdf, polyseed_coin coin, size_t key_size,
+    const uint8_t* key) {
+    if (key_size == 0 || key_size > KEYCACHE_MAX_KEY_SIZE) {
+        return;
+    }
+    cache_lock();
+    if (g_entries == NULL) {
+        g_entries = polyseed_secure_pages(CACHE_ENTRIES * sizeof(cache_entry));
+        if (g_entries == NULL) {
+            g_entries = g_static_entries;
+        }
+        atomic_store_explicit(&g_used, true, memory_order_relaxed);
+    }
+    /* another thread may have added the same key */
+    if (cache_find(seed, kdf, coin, key_size) == NULL) {
+        cache_entry* entry = &g_entries[g_next_entry];
+        g_next_entry = (g_next_entry + 1) % CACHE_ENTRIES;
+        entry_wipe(entry);
+        entry->seed = seed;
+        entry->data = *seed;
+        entry->kdf = kdf;
+        entry->coin = coin;
+        entry->key_size = key_size;
+        memcpy(entry->key, key, key_size);
+    }
+    cache_unlock();
+}
+
+POLYSEED_PRIVATE void polyseed_keycache_erase(const polyseed_data* seed) {
+    if (!atomic_load_explicit(&g_used, memory_order_relaxed)) {
+        return;
+    }
+    cache_lock();
+    for (int i = 0; i < CACHE_ENTRIES; ++i) {
+        if (g_entries[i].seed == seed) {
+            entry_wipe(&g_entries[i]);
+        }
+    }
+    cache_unlock();
+}
+
+void polyseed_enable_keygen_cache(int enable) {
+    polyseed_enable_keygen_cache_ctx(&polyseed_default_ctx, enable);
+}
+
+void polyseed_enable_keygen_cache_ctx(polyseed_context* ctx, int enable) {
+    assert(ctx != NULL);
+    ctx->keygen_cache = enable != 0;
+}
@@ -0,0 +1,29 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef KEYCACHE_H
+#define KEYCACHE_H
+
+#include "polyseed.h"
+#include "storage.h"
+
+#include <stdbool.h>
+
+/* Keys larger than this are not cached */
+#define KEYCACHE_MAX_KEY_SIZE 64
+
+/* Looks up a key derived from the seed by the kdf function.
+   Returns false if the key is not in the cache. */
+POLYSEED_PRIVATE bool polyseed_keycache_get(const polyseed_data* seed,
+    polyseed_pbkdf2* kdf, polyseed_coin coin, size_t key_size,
+    uint8_t* key_out);
+
+/* Adds a key derived from the seed by the kdf function to the cache */
+POLYSEED_PRIVATE void polyseed_keycache_put(const polyseed_data* seed,
+    polyseed_pbkdf2* kdf, polyseed_coin coin, size_t key_size,
+    const uint8_t* key);
+
+/* Erases all cached keys of a seed instance */
+POLYSEED_PRIVATE void polyseed_keycache_erase(const polyseed_data* seed);
+
+#endif
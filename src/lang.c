@@ -9,33 +9,11 @@
 #include <string.h>
 #include <stdlib.h>
 
-extern const polyseed_lang polyseed_lang_en;
-extern const polyseed_lang polyseed_lang_jp;
-extern const polyseed_lang polyseed_lang_ko;
-extern const polyseed_lang polyseed_lang_es;
-extern const polyseed_lang polyseed_lang_zh_s;
-extern const polyseed_lang polyseed_lang_zh_t;
-extern const polyseed_lang polyseed_lang_fr;
-extern const polyseed_lang polyseed_lang_it;
-extern const polyseed_lang polyseed_lang_cs;
-extern const polyseed_lang polyseed_lang_pt;
-
-static const polyseed_lang* languages[] = {
-    /* sorted wordlists first */
-    /* https://github.com/bitcoin/bips/blob/master/bip-0039/bip-0039-wordlists.md */
-    &polyseed_lang_en,
-    &polyseed_lang_jp,
-    &polyseed_lang_ko,
-    &polyseed_lang_es,
-    &polyseed_lang_fr,
-    &polyseed_lang_it,
-    &polyseed_lang_cs,
-    &polyseed_lang_pt,
-    &polyseed_lang_zh_s,
-    &polyseed_lang_zh_t,
-};
+/* generated by langgen from the lang_*.c wordlists */
+#include "lang_data.h"
 
 #define NUM_LANGS sizeof(languages) / sizeof(uintptr_t)
+#define LANG_MASK_ALL ((1u << NUM_LANGS) - 1)
 
 int polyseed_get_num_langs(void) {
     return NUM_LANGS;
@@ -56,197 +34,243 @@ const char* polyseed_get_lang_name_en(const polyseed_lang* lang) {
     return lang->name_en;
 }
 
-#define NUM_CHARS_PREFIX 4
-
-typedef int polyseed_cmp(const void* a, const void* b);
+static bool token_equals(const polyseed_token* tok, const polyseed_lang* lang,
+    int i) {
+    return tok->length == lang_word_length(lang, i) &&
+        0 == memcmp(tok->str, lang_word(lang, i), tok->length);
+}
 
-static int lang_search(const polyseed_lang* lang, const char* word,
-    polyseed_cmp* cmp) {
-    if (lang->is_sorted) {
-        const char** match = bsearch(&word, &lang->words[0],
-            POLYSEED_LANG_SIZE, sizeof(const char*), cmp);
-        if (match != NULL) {
-            return match - &lang->words[0];
-        }
-        return -1;
-    }
-    else {
-        for (int j = 0; j < POLYSEED_LANG_SIZE; ++j) {
-            if (0 == cmp(&word, &lang->words[j])) {
-                return j;
-            }
-        }
-        return -1;
+static int lang_hash_search(const polyseed_lang* lang,
+    const polyseed_token* tok) {
+    const polyseed_lang_index* index = lang->index;
+    uint64_t h = tok->hash;
+    unsigned disp = index->disp[phf_bucket(h, LANG_HASH_BUCKETS)];
+    int j = index->slots[phf_slot(h, disp, POLYSEED_LANG_SIZE)];
+    if (token_equals(tok, lang, j)) {
+        return j;
     }
+    return -1;
 }
 
-static int compare_str(const char* key, const char* elm) {
+static bool match_suffix(const char* key, const char* key_end,
+    const char* elm, bool fold) {
+    /* the rest of the key must be a prefix of the rest of the word */
     for (;;) {
-        if (*key == '\0' || *key != *elm) {
-            break;
+        if (fold) {
+            while (key != key_end && *key < 0) { /* skip non-ASCII */
+                ++key;
+            }
+            while (*elm < 0) { /* skip non-ASCII */
+                ++elm;
+            }
+        }
+        if (key == key_end) {
+            return true;
+        }
+        if (*key != *elm) {
+            return false;
         }
         ++key;
         ++elm;
     }
-    return (*key > *elm) - (*key < *elm);
 }
 
-static int compare_str_wrap(const void* a, const void* b) {
-    const char* key = *(const char**)a;
-    const char* elm = *(const char**)b;
-    return compare_str(key, elm);
+static bool match_token_suffix(const polyseed_token* tok,
+    const polyseed_lang* lang, int j) {
+    /* words shorter than the prefix must match exactly, which is implied
+       by the key */
+    if ((tok->prefix & 0xff) == 0) {
+        return true;
+    }
+    const char* elm_rest;
+    lang_prefix_key(lang_word(lang, j), lang->has_accents, &elm_rest);
+    return match_suffix(tok->rest, tok->str + tok->length, elm_rest,
+        lang->has_accents);
 }
 
-static int compare_prefix(const char* key, const char* elm, int n) {
-    for (int i = 1; ; ++i) {
-        if (*key == '\0') {
-            break;
-        }
-        if (i >= n && key[1] == '\0') {
-            break;
-        }
-        if (*key != *elm) {
-            break;
-        }
-        ++key;
-        ++elm;
+static int lang_prefix_search(const polyseed_lang* lang,
+    const polyseed_token* tok) {
+    /* the token keys are accent-folded, which is only valid for ASCII
+       words in languages without accents */
+    if (!lang->has_accents && !tok->ascii) {
+        return -1;
     }
-    return (*key > *elm) - (*key < *elm);
-}
+    uint32_t key = tok->prefix;
 
-static int compare_prefix_wrap(const void* a, const void* b) {
-    const char* key = *(const char**)a;
-    const char* elm = *(const char**)b;
-    return compare_prefix(key, elm, NUM_CHARS_PREFIX);
+    /* branchless binary search */
+    const uint32_t* base = lang->prefix_keys;
+    unsigned n = POLYSEED_LANG_SIZE;
+    while (n > 1) {
+        unsigned half = n / 2;
+        base = (base[half] <= key) ? base + half : base;
+        n -= half;
+    }
+    if (*base != key) {
+        return -1;
+    }
+    int j = base - lang->prefix_keys;
+    if (!match_token_suffix(tok, lang, j)) {
+        return -1;
+    }
+    return j;
 }
 
-static int compare_str_noaccent(const char* key, const char* elm) {
-    for (;;) {
-        while (*key < 0) { /* skip non-ASCII */
-            ++key;
-        }
-        while (*elm < 0) { /* skip non-ASCII */
-            ++elm;
-        }
-        if (*key == '\0' || *key != *elm) {
-            break;
-        }
-        ++key;
-        ++elm;
+static int lang_search(const polyseed_lang* lang, const polyseed_token* tok) {
+    if (lang->has_prefix) {
+        return lang_prefix_search(lang, tok);
+    }
+    else {
+        return lang_hash_search(lang, tok);
     }
-    return (*key > *elm) - (*key < *elm);
 }
 
-static int compare_str_noaccent_wrap(const void* a, const void* b) {
-    const char* key = *(const char**)a;
-    const char* elm = *(const char**)b;
-    return compare_str_noaccent(key, elm);
+int polyseed_lang_find_word(const polyseed_lang* lang, const char* word) {
+    polyseed_token tok;
+    lang_token_scan(word, word + strlen(word), &tok);
+    return lang_search(lang, &tok);
 }
 
-static int compare_prefix_noaccent(const char* key, const char* elm, int n) {
-    for (int i = 1; ; ++i) {
-        while (*key < 0) { /* skip non-ASCII */
-            ++key;
-        }
-        while (*elm < 0) { /* skip non-ASCII */
-            ++elm;
-        }
-        if (*key == '\0') {
-            break;
+int polyseed_phrase_split(const char* str, size_t length,
+    polyseed_phrase phrase) {
+    const char* pos = str;
+    const char* end = str + length;
+    int w = 0;
+
+    for (;;) {
+        while (pos != end && lang_is_space(*pos)) {
+            ++pos;
         }
-        if (i >= n && key[1] == '\0') {
+        if (pos == end) {
             break;
         }
-        if (*key != *elm) {
-            break;
+        if (w == POLYSEED_NUM_WORDS) {
+            return w + 1; /* too many words */
         }
-        ++key;
-        ++elm;
-    }
-    while (*key < 0) { /* skip non-ASCII */
-        ++key;
+        pos = lang_token_scan(pos, end, &phrase[w]);
+        ++w;
     }
-    while (*elm < 0) { /* skip non-ASCII */
-        ++elm;
-    }
-    return (*key > *elm) - (*key < *elm);
+    return w;
 }
 
-static int compare_prefix_noaccent_wrap(const void* a, const void* b) {
-    const char* key = *(const char**)a;
-    const char* elm = *(const char**)b;
-    return compare_prefix_noaccent(key, elm, NUM_CHARS_PREFIX);
+/* Matches of one word in the language table */
+typedef struct word_match {
+    const polyseed_lang_entry* prefix;
+    const polyseed_lang_entry* exact;
+} word_match;
+
+static inline unsigned popcount16(unsigned x) {
+    x = x - ((x >> 1) & 0x5555);
+    x = (x & 0x3333) + ((x >> 2) & 0x3333);
+    x = (x + (x >> 4)) & 0x0f0f;
+    return (x + (x >> 8)) & 0x1f;
 }
 
-static polyseed_cmp* get_comparer(const polyseed_lang* lang) {
-    if (lang->has_prefix) {
-        if (lang->has_accents) {
-            return &compare_prefix_noaccent_wrap;
+static const polyseed_lang_entry* lang_table_find(uint64_t key) {
+    uint64_t h = lang_table_hash(key);
+    unsigned disp = lang_table_disp[phf_bucket(h, LANG_TABLE_BUCKETS)];
+    return &lang_table[phf_slot(h, disp, LANG_TABLE_SIZE)];
+}
+
+static int lang_table_index(const polyseed_lang_entry* entry, int id) {
+    unsigned below = entry->mask & ((1u << id) - 1);
+    return lang_table_pool[entry->pos + popcount16(below)];
+}
+
+/* Looks up a word in all languages from the mask at once. Returns the mask
+   of languages that contain the word. */
+static unsigned lang_table_search(const polyseed_token* tok, unsigned mask,
+    word_match* match) {
+    unsigned found = 0;
+
+    if (mask & lang_mask_prefix) {
+        uint32_t key = tok->prefix;
+        const polyseed_lang_entry* entry = lang_table_find(key);
+        unsigned cand = entry->mask & mask & lang_mask_prefix;
+        /* only languages with accents can match non-ASCII words */
+        if (!tok->ascii) {
+            cand &= lang_mask_accents;
         }
-        else {
-            return &compare_prefix_wrap;
+        for (int id = 0; cand != 0; ++id, cand >>= 1) {
+            if ((cand & 1) == 0) {
+                continue;
+            }
+            const polyseed_lang* lang = languages[id];
+            int j = lang_table_index(entry, id);
+            if (lang->prefix_keys[j] != key) {
+                break; /* the slot belongs to a different key */
+            }
+            if (match_token_suffix(tok, lang, j)) {
+                found |= 1u << id;
+            }
         }
+        match->prefix = entry;
     }
-    else {
-        if (lang->has_accents) {
-            return &compare_str_noaccent_wrap;
-        }
-        else {
-            return &compare_str_wrap;
+
+    if (mask & ~lang_mask_prefix) {
+        const polyseed_lang_entry* entry =
+            lang_table_find(tok->hash | LANG_TAG_EXACT);
+        unsigned cand = entry->mask & mask & ~lang_mask_prefix;
+        if (cand != 0) {
+            /* all languages of the entry share the same word */
+            int id = 0;
+            while ((cand & (1u << id)) == 0) {
+                ++id;
+            }
+            int j = lang_table_index(entry, id);
+            if (token_equals(tok, languages[id], j)) {
+                found |= cand;
+            }
         }
+        match->exact = entry;
     }
-}
 
-int polyseed_lang_find_word(const polyseed_lang* lang, const char* word) {
-    polyseed_cmp* cmp = get_comparer(lang);
-    return lang_search(lang, word, cmp);
+    return found;
 }
 
 polyseed_status polyseed_phrase_decode(const polyseed_phrase phrase,
     uint_fast16_t idx_out[POLYSEED_NUM_WORDS], const polyseed_lang** lang_out) {
-    /* Iterate through all languages and try to find just one where
-       all the words are a match. */
-    uint_fast16_t idx[POLYSEED_NUM_WORDS];
-    bool have_lang = false;
-    for (int li = 0; li < NUM_LANGS; ++li) {
-        const polyseed_lang* lang = languages[li];
-        polyseed_cmp* cmp = get_comparer(lang);
-        bool success = true;
-        for (int wi = 0; wi < POLYSEED_NUM_WORDS; ++wi) {
-            const char* word = phrase[wi];
-            int value = lang_search(lang, word, cmp);
-            if (value < 0) {
-                success = false;
-                break;
-            }
-            idx[wi] = value;
-        }
-        if (!success) {
-            continue;
-        }
-        if (have_lang) {
-            /* The phrase can decode in multiple languages.
-            Use polyseed_phrase_decode_explicit. */
-            return POLYSEED_ERR_MULT_LANG;
-        }
-        have_lang = true;
-        for (int wi = 0; wi < POLYSEED_NUM_WORDS; ++wi) {
-            idx_out[wi] = idx[wi];
+    /* Look up each word in all languages at once and keep just
+       the languages where all the words are a match. Languages that
+       don't use the script of a word are pruned before the lookup. */
+    word_match matches[POLYSEED_NUM_WORDS];
+    unsigned mask = LANG_MASK_ALL;
+    for (int wi = 0; wi < POLYSEED_NUM_WORDS; ++wi) {
+        const polyseed_token* tok = &phrase[wi];
+        mask &= lang_script_mask[tok->script];
+        if (mask == 0) {
+            return POLYSEED_ERR_LANG;
         }
-        if (lang_out != NULL) {
-            *lang_out = lang;
+        mask &= lang_table_search(tok, mask, &matches[wi]);
+        if (mask == 0) {
+            return POLYSEED_ERR_LANG;
         }
     }
-    return have_lang ? POLYSEED_OK : POLYSEED_ERR_LANG;
+    if ((mask & (mask - 1)) != 0) {
+        /* The phrase can decode in multiple languages.
+        Use polyseed_phrase_decode_explicit. */
+        return POLYSEED_ERR_MULT_LANG;
+    }
+    int id = 0;
+    while (mask != (1u << id)) {
+        ++id;
+    }
+    const polyseed_lang* lang = languages[id];
+    for (int wi = 0; wi < POLYSEED_NUM_WORDS; ++wi) {
+        const polyseed_lang_entry* entry = lang->has_prefix ?
+            matches[wi].prefix : matches[wi].exact;
+        idx_out[wi] = lang_table_index(entry, id);
+    }
+    if (lang_out != NULL) {
+        *lang_out = lang;
+    }
+    return POLYSEED_OK;
 }
 
 polyseed_status polyseed_phrase_decode_explicit(const polyseed_phrase phrase,
     const polyseed_lang* lang, uint_fast16_t idx_out[POLYSEED_NUM_WORDS]) {
 
-    polyseed_cmp* cmp = get_comparer(lang);
     for (int wi = 0; wi < POLYSEED_NUM_WORDS; ++wi) {
-        const char* word = phrase[wi];
-        int value = lang_search(lang, word, cmp);
+        int value = lang_search(lang, &phrase[wi]);
         if (value < 0) {
             return POLYSEED_ERR_LANG;
         }
@@ -254,29 +278,3 @@ polyseed_status polyseed_phrase_decode_explicit(const polyseed_phrase phrase,
     }
     return POLYSEED_OK;
 }
-
-void polyseed_lang_check(const polyseed_lang* lang) {
-    /* check the language is sorted correctly */
-    if (lang->is_sorted) {
-        polyseed_cmp* cmp = get_comparer(lang);
-        const char* prev = lang->words[0];
-        for (int i = 1; i < POLYSEED_LANG_SIZE; ++i) {
-            const char* word = lang->words[i];
-            assert(("incorrectly sorted wordlist", cmp(&prev, &word) < 0));
-            prev = word;
-        }
-    }
-    /* all words must be in NFKD */
-    for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
-        polyseed_str norm;
-        const char* word = lang->words[i];
-        UTF8_DECOMPOSE(word, norm);
-        assert(("incorrectly normalized wordlist", !strcmp(word, norm)));
-    }
-    /* accented languages must be composed */
-    assert(!lang->has_accents || lang->compose);
-    /* normalized separator must be a space */
-    polyseed_str separator;
-    UTF8_DECOMPOSE(lang->separator, separator);
-    assert(!strcmp(" ", separator));
-}
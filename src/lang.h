@@ -6,11 +6,51 @@
 
 #include "polyseed.h"
 
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #define POLYSEED_LANG_SIZE 2048
 
-typedef struct polyseed_lang {
+/* Number of characters that identify a word in prefix languages */
+#define NUM_CHARS_PREFIX 4
+
+/* Minimal perfect hash of a wordlist (hash and displace) */
+#define LANG_HASH_BUCKETS 512
+
+typedef struct polyseed_lang_index {
+    uint16_t disp[LANG_HASH_BUCKETS];
+    uint16_t slots[POLYSEED_LANG_SIZE];
+} polyseed_lang_index;
+
+/* Perfect hash of all words of all languages. Each key maps to the set
+   of languages containing the key and the word indices in those languages.
+   Prefix languages are keyed by the accent-folded word prefix, exact-match
+   languages by the hash of the whole word tagged with LANG_TAG_EXACT. */
+#define LANG_TABLE_BUCKETS 4096
+#define LANG_TABLE_SIZE 16384
+#define LANG_TAG_EXACT (UINT64_C(1) << 63)
+
+typedef struct polyseed_lang_entry {
+    /* bitmask of languages (0 = empty slot) */
+    uint16_t mask;
+    /* position of the word indices in the index pool */
+    uint16_t pos;
+} polyseed_lang_entry;
+
+/* Script classes of the first character of a word (after NFKD) */
+enum {
+    LANG_SCRIPT_LATIN,  /* ASCII */
+    LANG_SCRIPT_HANGUL, /* Hangul Jamo U+1100 - U+11FF */
+    LANG_SCRIPT_KANA,   /* Hiragana and Katakana U+3040 - U+30FF */
+    LANG_SCRIPT_CJK,    /* CJK ideographs U+3400 - U+9FFF */
+    LANG_SCRIPT_OTHER,
+    LANG_NUM_SCRIPTS
+};
+
+/* Wordlist as defined in the lang_*.c source files. The wordlists are
+   compiled into the polyseed_lang structures by the langgen tool. */
+typedef struct polyseed_wordlist {
     const char* name;
     const char* name_en;
     const char* separator;
@@ -19,9 +59,208 @@ typedef struct polyseed_lang {
     bool has_accents;
     bool compose;
     const char* words[POLYSEED_LANG_SIZE];
+} polyseed_wordlist;
+
+/* Location of a word in the string blob of a language */
+typedef struct polyseed_lang_word {
+    uint16_t offset;
+    uint16_t length;
+} polyseed_lang_word;
+
+typedef struct polyseed_lang {
+    const char* name;
+    const char* name_en;
+    const char* separator;
+    bool has_prefix;
+    bool has_accents;
+    /* exact-match lookup index (NULL for prefix languages) */
+    const polyseed_lang_index* index;
+    /* sorted packed word prefixes (NULL for exact-match languages) */
+    const uint32_t* prefix_keys;
+    /* null-terminated words stored back to back (NFKD) */
+    const char* blob;
+    const polyseed_lang_word* words;
+    /* composed words for the output of polyseed_encode (NFC) */
+    const char* nfc_blob;
+    const polyseed_lang_word* nfc_words;
 } polyseed_lang;
 
-typedef const char* polyseed_phrase[POLYSEED_NUM_WORDS];
+/* Word of a phrase with the keys used to look it up. Tokens point into
+   the phrase string and are not null-terminated. */
+typedef struct polyseed_token {
+    const char* str;
+    size_t length;
+    /* hash of the whole word for exact-match languages */
+    uint64_t hash;
+    /* accent-folded prefix key and the remainder of the word after it */
+    uint32_t prefix;
+    const char* rest;
+    bool ascii;
+    int script;
+} polyseed_token;
+
+typedef polyseed_token polyseed_phrase[POLYSEED_NUM_WORDS];
+
+static inline const char* lang_word(const polyseed_lang* lang, int i) {
+    return lang->blob + lang->words[i].offset;
+}
+
+static inline size_t lang_word_length(const polyseed_lang* lang, int i) {
+    return lang->words[i].length;
+}
+
+static inline const char* lang_word_nfc(const polyseed_lang* lang, int i) {
+    return lang->nfc_blob + lang->nfc_words[i].offset;
+}
+
+static inline size_t lang_word_nfc_length(const polyseed_lang* lang, int i) {
+    return lang->nfc_words[i].length;
+}
+
+/* splitmix64 finalizer */
+static inline uint64_t lang_hash_mix(uint64_t h) {
+    h ^= h >> 30;
+    h *= UINT64_C(0xbf58476d1ce4e5b9);
+    h ^= h >> 27;
+    h *= UINT64_C(0x94d049bb133111eb);
+    h ^= h >> 31;
+    return h;
+}
+
+/* 64-bit FNV-1a */
+#define LANG_FNV_OFFSET UINT64_C(14695981039346656037)
+#define LANG_FNV_PRIME UINT64_C(1099511628211)
+
+static inline uint64_t lang_hash(const char* word) {
+    uint64_t h = LANG_FNV_OFFSET;
+    while (*word != '\0') {
+        h ^= (uint8_t)*word;
+        h *= LANG_FNV_PRIME;
+        ++word;
+    }
+    return lang_hash_mix(h);
+}
+
+/* Hash and displace: keys are split into buckets by the upper half of the
+   hash and each bucket has a displacement value that moves its keys to
+   free slots. The number of buckets and slots must be powers of 2. */
+static inline unsigned phf_bucket(uint64_t h, unsigned num_buckets) {
+    return (unsigned)(h >> 32) & (num_buckets - 1);
+}
+
+static inline unsigned phf_slot(uint64_t h, unsigned disp,
+    unsigned num_slots) {
+    /* murmur3 finalizer */
+    uint32_t x = (uint32_t)h ^ (disp * UINT32_C(0x9e3779b9));
+    x ^= x >> 16;
+    x *= UINT32_C(0x85ebca6b);
+    x ^= x >> 13;
+    x *= UINT32_C(0xc2b2ae35);
+    x ^= x >> 16;
+    return x & (num_slots - 1);
+}
+
+/* Hash of a language table key. Exact-match keys are already hashed. */
+static inline uint64_t lang_table_hash(uint64_t key) {
+    return (key & LANG_TAG_EXACT) ? key : lang_hash_mix(key);
+}
+
+/* Classifies a word by the UTF-8 lead bytes of its first character */
+static inline int lang_script(const char* word) {
+    uint8_t b0 = (uint8_t)word[0];
+    if (b0 < 0x80) {
+        return LANG_SCRIPT_LATIN;
+    }
+    uint8_t b1 = (uint8_t)word[1];
+    if (b0 == 0xe1 && b1 >= 0x84 && b1 <= 0x87) {
+        return LANG_SCRIPT_HANGUL;
+    }
+    if (b0 == 0xe3 && b1 >= 0x81 && b1 <= 0x83) {
+        return LANG_SCRIPT_KANA;
+    }
+    if ((b0 == 0xe3 && b1 >= 0x90) || (b0 >= 0xe4 && b0 <= 0xe9)) {
+        return LANG_SCRIPT_CJK;
+    }
+    return LANG_SCRIPT_OTHER;
+}
+
+/* Packs the first NUM_CHARS_PREFIX characters of a word into an integer
+   that sorts in the same order as the strings. Non-ASCII bytes are skipped
+   if fold is true. The end of the prefix is stored in *rest. */
+static inline uint32_t lang_prefix_key(const char* word, bool fold,
+    const char** rest) {
+    uint32_t key = 0;
+    int i = 0;
+    for (; i < NUM_CHARS_PREFIX; ++i) {
+        if (fold) {
+            while (*word < 0) { /* skip non-ASCII */
+                ++word;
+            }
+        }
+        if (*word == '\0') {
+            break;
+        }
+        key = (key << 8) | (uint8_t)*word;
+        ++word;
+    }
+    if (i > 0) {
+        key <<= 8 * (NUM_CHARS_PREFIX - i);
+    }
+    *rest = word;
+    return key;
+}
+
+/* Word separators: ASCII whitespace. Other spaces, such as the ideographic
+   space, are mapped to U+0020 by the normalization. */
+static inline bool lang_is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/* Scans one word starting at pos and computes all its lookup keys in
+   the same pass. The word ends at whitespace or at the end of the string.
+   Returns the end of the word. */
+static inline const char* lang_token_scan(const char* pos, const char* end,
+    polyseed_token* tok) {
+    uint64_t h = LANG_FNV_OFFSET;
+    uint32_t key = 0;
+    int chars = 0;
+    uint8_t bits = 0;
+    tok->str = pos;
+    tok->script = pos < end ? lang_script(pos) : LANG_SCRIPT_OTHER;
+    tok->rest = NULL;
+    for (; pos < end && !lang_is_space(*pos); ++pos) {
+        uint8_t c = (uint8_t)*pos;
+        h ^= c;
+        h *= LANG_FNV_PRIME;
+        bits |= c;
+        if (c < 0x80 && chars < NUM_CHARS_PREFIX) {
+            key = (key << 8) | c;
+            if (++chars == NUM_CHARS_PREFIX) {
+                tok->rest = pos + 1;
+            }
+        }
+    }
+    if (chars < NUM_CHARS_PREFIX) {
+        /* a word without ASCII characters has a zero key */
+        if (chars > 0) {
+            key <<= 8 * (NUM_CHARS_PREFIX - chars);
+        }
+        tok->rest = pos;
+    }
+    tok->length = pos - tok->str;
+    tok->hash = lang_hash_mix(h);
+    tok->prefix = key;
+    tok->ascii = bits < 0x80;
+    return pos;
+}
+
+/*
+ * Splits a normalized phrase into words separated by runs of whitespace.
+ * Returns the number of words or POLYSEED_NUM_WORDS + 1 if there are
+ * too many words.
+ */
+POLYSEED_PRIVATE int polyseed_phrase_split(const char* str, size_t length,
+    polyseed_phrase phrase);
 
 POLYSEED_PRIVATE int polyseed_lang_find_word(const polyseed_lang* lang,
     const char* word);
@@ -32,6 +271,4 @@ POLYSEED_PRIVATE polyseed_status polyseed_phrase_decode(const polyseed_phrase ph
 POLYSEED_PRIVATE polyseed_status polyseed_phrase_decode_explicit(const polyseed_phrase phrase,
     const polyseed_lang* lang, uint_fast16_t idx_out[POLYSEED_NUM_WORDS]);
 
-POLYSEED_PRIVATE void polyseed_lang_check(const polyseed_lang* lang);
-
 #endif
@@ -3,7 +3,7 @@
 /* Based on BIP-39 with the correct word order */
 /* https://github.com/bitcoin/bips/pull/493#issuecomment-970511014 */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_cs = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_cs = {
     .name = u8"čeština",
     .name_en = "Czech",
     .separator = " ",
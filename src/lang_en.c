@@ -2,7 +2,7 @@
 
 /* Based on BIP-39 (unchanged) */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_en = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_en = {
     .name = "English",
     .name_en = "English",
     .separator = " ",
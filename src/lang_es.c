@@ -2,7 +2,7 @@
 
 /* Based on BIP-39 with an accent-insensitive word order */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_es = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_es = {
     .name = u8"español",
     .name_en = "Spanish",
     .separator = " ",
@@ -2,7 +2,7 @@
 
 /* Based on BIP-39 (unchanged) */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_fr = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_fr = {
     .name = u8"français",
     .name_en = "French",
     .separator = " ",
@@ -2,7 +2,7 @@
 
 /* Based on BIP-39 (unchanged) */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_it = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_it = {
     .name = "italiano",
     .name_en = "Italian",
     .separator = " ",
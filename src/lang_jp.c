@@ -2,7 +2,7 @@
 
 /* Based on BIP-39 with ordinal sorting */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_jp = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_jp = {
     .name = u8"日本語",
     .name_en = "Japanese",
     .separator = u8"\u3000",
@@ -2,7 +2,7 @@
 
 /* Based on BIP-39 (unchanged) */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_ko = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_ko = {
     .name = u8"한국어",
     .name_en = "Korean",
     .separator = " ",
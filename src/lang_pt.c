@@ -2,7 +2,7 @@
 
 /* Based on BIP-39 (unchanged) */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_pt = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_pt = {
     .name = u8"português",
     .name_en = "Portuguese",
     .separator = " ",
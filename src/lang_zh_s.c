@@ -2,7 +2,7 @@
 
 /* Based on BIP-39 (unchanged) */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_zh_s = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_zh_s = {
     .name = u8"中文(简体)",
     .name_en = "Chinese (Simplified)",
     .separator = " ",
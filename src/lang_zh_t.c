@@ -2,7 +2,7 @@
 
 /* Based on BIP-39 (unchanged) */
 
-POLYSEED_PRIVATE const polyseed_lang polyseed_lang_zh_t = {
+POLYSEED_PRIVATE const polyseed_wordlist polyseed_wordlist_zh_t = {
     .name = u8"中文(繁體)",
     .name_en = "Chinese (Traditional)",
     .separator = " ",
@@ -2,11 +2,13 @@
 /* See LICENSE for licensing information */
 
 #include "polyseed.h"
+#include "async.h"
 #include "dependency.h"
 #include "birthday.h"
 #include "features.h"
 #include "lang.h"
 #include "gf.h"
+#include "keycache.h"
 #include "storage.h"
 
 #include <stdint.h>
@@ -27,76 +29,334 @@ static void write_str(char** pos, const char* str) {
     *pos = loc;
 }
 
-static int str_split(char* str, polyseed_phrase words) {
-    char* pos = str;
-    char* word = str;
-    int w = 0;
+static void write_word(char** pos, const polyseed_lang* lang, int i) {
+    size_t length = lang_word_nfc_length(lang, i);
+    memcpy(*pos, lang_word_nfc(lang, i), length);
+    *pos += length;
+}
 
-    /* split on space */
-    while (*pos != '\0') {
-        while (*pos != '\0' && *pos != ' ') {
-            ++pos;
-        }
-        words[w] = word;
-        if (*pos != '\0') {
-            *pos = '\0';
-            ++pos;
-        }
-        word = pos;
-        ++w;
-        if (w == POLYSEED_NUM_WORDS) {
-            if (*pos != '\0') {
-                ++w; /* too many words */
-            }
-            break;
-        }
+/* Writes the words of an encoded polynomial. The wordlists are
+   precomposed, so the phrase is written directly in the canonical
+   composed form. Returns the end of the phrase (not null-terminated). */
+static char* write_phrase(char* pos, const polyseed_lang* lang,
+    const gf_poly* poly) {
+    int w;
+    for (w = 0; w < POLYSEED_NUM_WORDS - 1; ++w) {
+        write_word(&pos, lang, poly->coeff[w]);
+        write_str(&pos, lang->separator);
+    }
+    write_word(&pos, lang, poly->coeff[w]);
+    return pos;
+}
+
+/* Length of the phrase written by write_phrase */
+static size_t phrase_length(const polyseed_lang* lang, const gf_poly* poly,
+    size_t separator_length) {
+    size_t length = (POLYSEED_NUM_WORDS - 1) * separator_length;
+    for (int w = 0; w < POLYSEED_NUM_WORDS; ++w) {
+        length += lang_word_nfc_length(lang, poly->coeff[w]);
     }
-    return w;
+    return length;
+}
+
+/* Length of a string that ends after max bytes or at a null character */
+static size_t str_length(const char* str, size_t max) {
+    const char* nul = memchr(str, '\0', max);
+    return nul != NULL ? (size_t)(nul - str) : max;
+}
+
+/* Number of seeds of a batch that share one call to randbytes */
+#define CREATE_BATCH_CHUNK 64
+
+/* Clears the unused bits of the secret and calculates the checksum */
+static void seed_finalize(const polyseed_context* ctx, polyseed_data* seed) {
+    seed->secret[SECRET_SIZE - 1] &= CLEAR_MASK;
+
+    /* encode polynomial */
+    gf_poly poly = { 0 };
+    polyseed_data_to_poly(seed, &poly);
+
+    /* calculate checksum */
+    gf_poly_encode(&poly);
+    seed->checksum = poly.coeff[0];
+
+    MEMZERO_LOC(ctx, poly);
+}
+
+static void create_seed(const polyseed_context* ctx, unsigned seed_features,
+    polyseed_data* seed) {
+    seed->birthday = birthday_encode(GET_TIME(ctx));
+    seed->features = seed_features;
+    memset(seed->secret, 0, sizeof(seed->secret));
+    GET_RANDOM_BYTES(ctx, seed->secret, SECRET_SIZE);
+    seed_finalize(ctx, seed);
+}
+
+/* Working memory for decoding a phrase. Contains secret data after use. */
+typedef struct decode_state {
+    polyseed_str str_tmp;
+    polyseed_phrase words;
+    gf_poly poly;
+} decode_state;
+
+/* Decodes a phrase into the seed data. The language is detected if lang
+   is NULL. The working memory must be erased by the caller, which allows
+   it to be reused for multiple phrases. */
+static polyseed_status decode_phrase_state(const polyseed_context* ctx,
+    decode_state* state, const char* str, size_t length, polyseed_coin coin,
+    const polyseed_lang* lang, const polyseed_lang** lang_out,
+    polyseed_data* data) {
+
+    /* canonical decomposition (ASCII phrases are used in place) */
+    size_t str_size;
+    length = str_length(str, length);
+    const char* str_norm = UTF8_DECOMPOSE(ctx, str, length, state->str_tmp,
+        &str_size);
+    if (str_norm == NULL) {
+        return POLYSEED_ERR_UTF8;
+    }
+    assert(str_size < POLYSEED_STR_SIZE);
+
+    /* split into words and compute their lookup keys */
+    if (polyseed_phrase_split(str_norm, str_size, state->words)
+        != POLYSEED_NUM_WORDS) {
+        return POLYSEED_ERR_NUM_WORDS;
+    }
+
+    /* decode words into polynomial coefficients */
+    polyseed_status res;
+    if (lang != NULL) {
+        res = polyseed_phrase_decode_explicit(state->words, lang,
+            state->poly.coeff);
+    }
+    else {
+        res = polyseed_phrase_decode(state->words, state->poly.coeff,
+            lang_out);
+    }
+
+    if (res != POLYSEED_OK) {
+        return res;
+    }
+
+    /* finalize polynomial */
+    state->poly.coeff[POLY_NUM_CHECK_DIGITS] ^= coin;
+
+    /* checksum */
+    if (!gf_poly_check(&state->poly)) {
+        return POLYSEED_ERR_CHECKSUM;
+    }
+
+    /* decode polynomial into seed data */
+    polyseed_poly_to_data(&state->poly, data);
+
+    /* check features */
+    if (!polyseed_features_supported(ctx, data->features)) {
+        return POLYSEED_ERR_UNSUPPORTED;
+    }
+
+    return POLYSEED_OK;
+}
+
+/* Decodes a phrase into the seed. The language is detected if lang
+   is NULL. The seed is not modified if the decoding fails. */
+static polyseed_status decode_phrase(const polyseed_context* ctx,
+    const char* str, size_t length, polyseed_coin coin,
+    const polyseed_lang* lang, const polyseed_lang** lang_out,
+    polyseed_data* seed) {
+
+    decode_state state;
+    polyseed_data data;
+
+    polyseed_status res = decode_phrase_state(ctx, &state, str, length, coin,
+        lang, lang_out, &data);
+    if (res == POLYSEED_OK) {
+        *seed = data;
+    }
+
+    MEMZERO_LOC(ctx, state);
+    MEMZERO_LOC(ctx, data);
+    return res;
+}
+
+/* Loads a serialized seed into the seed data. The seed is not modified
+   if the loading fails. */
+static polyseed_status load_seed(const polyseed_context* ctx,
+    const polyseed_storage storage, polyseed_data* seed) {
+
+    gf_poly poly = { 0 };
+    polyseed_data data;
+    polyseed_status res;
+
+    /* deserialize data */
+    res = polyseed_data_load(storage, &data);
+    if (res != POLYSEED_OK) {
+        goto cleanup;
+    }
+
+    /* encode polynomial with the existing checksum */
+    poly.coeff[0] = data.checksum;
+    polyseed_data_to_poly(&data, &poly);
+
+    /* checksum */
+    if (!gf_poly_check(&poly)) {
+        res = POLYSEED_ERR_CHECKSUM;
+        goto cleanup;
+    }
+
+    /* check features */
+    if (!polyseed_features_supported(ctx, data.features)) {
+        res = POLYSEED_ERR_UNSUPPORTED;
+        goto cleanup;
+    }
+
+    *seed = data;
+    res = POLYSEED_OK;
+
+cleanup:
+    MEMZERO_LOC(ctx, poly);
+    MEMZERO_LOC(ctx, data);
+    return res;
+}
+
+/* Moves the decoded seed data to newly allocated memory */
+static polyseed_status alloc_seed(const polyseed_context* ctx,
+    polyseed_data* data, polyseed_data** seed_out) {
+    polyseed_data* seed = ALLOC(ctx, sizeof(polyseed_data));
+    if (seed == NULL) {
+        MEMZERO_PTR(ctx, data, polyseed_data);
+        return POLYSEED_ERR_MEMORY;
+    }
+    *seed = *data;
+    MEMZERO_PTR(ctx, data, polyseed_data);
+    *seed_out = seed;
+    return POLYSEED_OK;
 }
 
 polyseed_status polyseed_create(unsigned features, polyseed_data** seed_out) {
-    CHECK_DEPS();
+    return polyseed_create_ctx(&polyseed_default_ctx, features, seed_out);
+}
+
+polyseed_status polyseed_create_ctx(const polyseed_context* ctx,
+    unsigned features, polyseed_data** seed_out) {
+    assert(ctx != NULL);
+    CHECK_DEPS(ctx);
 
     /* check features */
     unsigned seed_features = make_features(features);
-    if (!polyseed_features_supported(seed_features)) {
+    if (!polyseed_features_supported(ctx, seed_features)) {
         return POLYSEED_ERR_UNSUPPORTED;
     }
 
     /* alocate memory */
-    polyseed_data* seed = ALLOC(sizeof(polyseed_data));
+    polyseed_data* seed = ALLOC(ctx, sizeof(polyseed_data));
     if (seed == NULL) {
         return POLYSEED_ERR_MEMORY;
     }
 
-    /* create seed */
-    seed->birthday = birthday_encode(GET_TIME());
-    seed->features = seed_features;
-    memset(seed->secret, 0, sizeof(seed->secret));
-    GET_RANDOM_BYTES(seed->secret, SECRET_SIZE);
-    seed->secret[SECRET_SIZE - 1] &= CLEAR_MASK;
+    create_seed(ctx, seed_features, seed);
 
-    /* encode polynomial */
-    gf_poly poly = { 0 };
-    polyseed_data_to_poly(seed, &poly);
+    *seed_out = seed;
+    return POLYSEED_OK;
+}
 
-    /* calculate checksum */
-    gf_poly_encode(&poly);
-    seed->checksum = poly.coeff[0];
+polyseed_status polyseed_create_into(unsigned features, polyseed_data* seed) {
+    return polyseed_create_into_ctx(&polyseed_default_ctx, features, seed);
+}
 
-    MEMZERO_LOC(poly);
+polyseed_status polyseed_create_into_ctx(const polyseed_context* ctx,
+    unsigned features, polyseed_data* seed) {
+    assert(ctx != NULL);
+    assert(seed != NULL);
+    CHECK_DEPS(ctx);
+
+    /* check features */
+    unsigned seed_features = make_features(features);
+    if (!polyseed_features_supported(ctx, seed_features)) {
+        return POLYSEED_ERR_UNSUPPORTED;
+    }
+
+    create_seed(ctx, seed_features, seed);
 
-    *seed_out = seed;
     return POLYSEED_OK;
 }
 
+polyseed_status polyseed_create_batch(unsigned features, size_t count,
+    polyseed_storage* storage_out) {
+    return polyseed_create_batch_ctx(&polyseed_default_ctx, features, count,
+        storage_out);
+}
+
+polyseed_status polyseed_create_batch_ctx(const polyseed_context* ctx,
+    unsigned features, size_t count, polyseed_storage* storage_out) {
+    assert(ctx != NULL);
+    assert(storage_out != NULL || count == 0);
+    CHECK_DEPS(ctx);
+
+    /* check features */
+    unsigned seed_features = make_features(features);
+    if (!polyseed_features_supported(ctx, seed_features)) {
+        return POLYSEED_ERR_UNSUPPORTED;
+    }
+
+    /* all seeds of the batch have the same birthday */
+    unsigned birthday = birthday_encode(GET_TIME(ctx));
+    uint8_t entropy[CREATE_BATCH_CHUNK * SECRET_SIZE];
+    polyseed_data seed;
+
+    memset(seed.secret, 0, sizeof(seed.secret));
+    seed.birthday = birthday;
+    seed.features = seed_features;
+
+    for (size_t i = 0; i < count; i += CREATE_BATCH_CHUNK) {
+        size_t chunk = count - i;
+        if (chunk > CREATE_BATCH_CHUNK) {
+            chunk = CREATE_BATCH_CHUNK;
+        }
+        GET_RANDOM_BYTES(ctx, entropy, chunk * SECRET_SIZE);
+        for (size_t j = 0; j < chunk; ++j) {
+            memcpy(seed.secret, &entropy[j * SECRET_SIZE], SECRET_SIZE);
+            seed_finalize(ctx, &seed);
+            polyseed_data_store(&seed, storage_out[i + j]);
+        }
+    }
+
+    MEMZERO_LOC(ctx, entropy);
+    MEMZERO_LOC(ctx, seed);
+    return POLYSEED_OK;
+}
+
+size_t polyseed_data_size(void) {
+    return sizeof(polyseed_data);
+}
+
+size_t polyseed_data_align(void) {
+    return _Alignof(polyseed_data);
+}
+
 void polyseed_free(polyseed_data* seed) {
+    polyseed_free_ctx(&polyseed_default_ctx, seed);
+}
+
+void polyseed_free_ctx(const polyseed_context* ctx, polyseed_data* seed) {
+    assert(ctx != NULL);
     if (seed != NULL) {
-        MEMZERO_PTR(seed, polyseed_data);
-        FREE(seed);
+        polyseed_keycache_erase(seed);
+        MEMZERO_PTR(ctx, seed, polyseed_data);
+        FREE(ctx, seed);
     }
 }
 
+void polyseed_erase(polyseed_data* seed) {
+    polyseed_erase_ctx(&polyseed_default_ctx, seed);
+}
+
+void polyseed_erase_ctx(const polyseed_context* ctx, polyseed_data* seed) {
+    assert(ctx != NULL);
+    assert(seed != NULL);
+    polyseed_keycache_erase(seed);
+    MEMZERO_PTR(ctx, seed, polyseed_data);
+}
+
 uint64_t polyseed_get_birthday(const polyseed_data* data) {
     assert(data != NULL);
     return birthday_decode(data->birthday);
@@ -109,12 +369,20 @@ unsigned polyseed_get_feature(const polyseed_data* seed, unsigned mask) {
 
 size_t polyseed_encode(const polyseed_data* data, const polyseed_lang* lang,
     polyseed_coin coin, polyseed_str str_out) {
+    return polyseed_encode_ctx(&polyseed_default_ctx, data, lang, coin,
+        str_out);
+}
+
+size_t polyseed_encode_ctx(const polyseed_context* ctx,
+    const polyseed_data* data, const polyseed_lang* lang, polyseed_coin coin,
+    polyseed_str str_out) {
 
+    assert(ctx != NULL);
     assert(data != NULL);
     assert(lang != NULL);
     assert((gf_elem)coin < GF_SIZE);
     assert(str_out != NULL);
-    CHECK_DEPS();
+    CHECK_DEPS(ctx);
 
     /* encode polynomial with the existing checksum */
     gf_poly poly = { 0 };
@@ -124,175 +392,265 @@ size_t polyseed_encode(const polyseed_data* data, const polyseed_lang* lang,
     /* apply coin */
     poly.coeff[POLY_NUM_CHECK_DIGITS] ^= coin;
 
-    polyseed_str str_tmp;
-    char* pos = str_tmp;
-    int w;
-    size_t str_size;
-
-#define WORD(i) lang->words[poly.coeff[i]]
-
-    /* output words */
-    for (w = 0; w < POLYSEED_NUM_WORDS - 1; ++w) {
-        write_str(&pos, WORD(w));
-        write_str(&pos, lang->separator);
-    }
-    write_str(&pos, WORD(w));
+    char* pos = write_phrase(str_out, lang, &poly);
     *pos = '\0';
-    str_size = pos - str_tmp;
+    size_t str_size = pos - str_out;
     assert(str_size < POLYSEED_STR_SIZE);
 
-#undef WORD
+    MEMZERO_LOC(ctx, poly);
 
-    /* compose if needed by the language */
-    if (lang->compose) {
-        str_size = UTF8_COMPOSE(str_tmp, str_out);
-        assert(str_size < POLYSEED_STR_SIZE);
-    }
-    else {
-        memcpy(str_out, str_tmp, str_size + 1);
-    }
+    return str_size;
+}
 
-    MEMZERO_LOC(poly);
-    MEMZERO_LOC(str_tmp);
+size_t polyseed_encode_batch(const polyseed_storage* storage, size_t count,
+    const polyseed_lang* lang, polyseed_coin coin, char* buffer,
+    size_t buffer_size, size_t* offsets_out, polyseed_status* status_out) {
+    return polyseed_encode_batch_ctx(&polyseed_default_ctx, storage, count,
+        lang, coin, buffer, buffer_size, offsets_out, status_out);
+}
 
-    return str_size;
+size_t polyseed_encode_batch_ctx(const polyseed_context* ctx,
+    const polyseed_storage* storage, size_t count, const polyseed_lang* lang,
+    polyseed_coin coin, char* buffer, size_t buffer_size, size_t* offsets_out,
+    polyseed_status* status_out) {
+
+    assert(ctx != NULL);
+    assert(storage != NULL || count == 0);
+    assert(lang != NULL);
+    assert((gf_elem)coin < GF_SIZE);
+    assert(buffer != NULL || buffer_size == 0);
+    assert(offsets_out != NULL);
+    assert(status_out != NULL || count == 0);
+    CHECK_DEPS(ctx);
+
+    size_t separator_length = strlen(lang->separator);
+    polyseed_data data;
+    gf_poly poly;
+    size_t offset = 0;
+    size_t i;
+
+    offsets_out[0] = 0;
+    for (i = 0; i < count; ++i) {
+        polyseed_status res = load_seed(ctx, storage[i], &data);
+        if (res == POLYSEED_OK) {
+            /* encode polynomial with the existing checksum */
+            poly.coeff[0] = data.checksum;
+            polyseed_data_to_poly(&data, &poly);
+            poly.coeff[POLY_NUM_CHECK_DIGITS] ^= coin;
+
+            size_t length = phrase_length(lang, &poly, separator_length);
+            if (length > buffer_size - offset) {
+                break; /* not enough space */
+            }
+            offset = write_phrase(buffer + offset, lang, &poly) - buffer;
+        }
+        status_out[i] = res;
+        offsets_out[i + 1] = offset;
+    }
+
+    MEMZERO_LOC(ctx, data);
+    MEMZERO_LOC(ctx, poly);
+    return i;
 }
 
 polyseed_status polyseed_decode(const char* str, polyseed_coin coin,
     const polyseed_lang** lang_out, polyseed_data** seed_out) {
 
     assert(str != NULL);
-    assert((gf_elem)coin < GF_SIZE);
-    assert(seed_out != NULL);
-    CHECK_DEPS();
+    return polyseed_decode_n_ctx(&polyseed_default_ctx, str, strlen(str), coin,
+        lang_out, seed_out);
+}
 
-    polyseed_str str_tmp;
-    polyseed_phrase words;
-    gf_poly poly = { 0 };
-    polyseed_status res;
-    polyseed_data* seed;
+polyseed_status polyseed_decode_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang** lang_out,
+    polyseed_data** seed_out) {
 
-    /* canonical decomposition */
-    size_t str_size = UTF8_DECOMPOSE(str, str_tmp);
-    assert(str_size < POLYSEED_STR_SIZE);
+    assert(str != NULL);
+    return polyseed_decode_n_ctx(ctx, str, strlen(str), coin, lang_out,
+        seed_out);
+}
 
-    /* split into words */
-    if (str_split(str_tmp, words) != POLYSEED_NUM_WORDS) {
-        res = POLYSEED_ERR_NUM_WORDS;
-        goto cleanup;
-    }
+polyseed_status polyseed_decode_n(const char* str, size_t length,
+    polyseed_coin coin, const polyseed_lang** lang_out,
+    polyseed_data** seed_out) {
+    return polyseed_decode_n_ctx(&polyseed_default_ctx, str, length, coin,
+        lang_out, seed_out);
+}
 
-    /* decode words into polynomial coefficients */
-    res = polyseed_phrase_decode(words, poly.coeff, lang_out);
+polyseed_status polyseed_decode_n_ctx(const polyseed_context* ctx,
+    const char* str, size_t length, polyseed_coin coin,
+    const polyseed_lang** lang_out, polyseed_data** seed_out) {
 
+    assert(ctx != NULL);
+    assert(str != NULL);
+    assert((gf_elem)coin < GF_SIZE);
+    assert(seed_out != NULL);
+    CHECK_DEPS(ctx);
+
+    polyseed_data data;
+    polyseed_status res = decode_phrase(ctx, str, length, coin, NULL, lang_out,
+        &data);
     if (res != POLYSEED_OK) {
-        goto cleanup;
+        return res;
     }
+    return alloc_seed(ctx, &data, seed_out);
+}
 
-    /* finalize polynomial */
-    poly.coeff[POLY_NUM_CHECK_DIGITS] ^= coin;
+polyseed_status polyseed_decode_into(const char* str, polyseed_coin coin,
+    const polyseed_lang** lang_out, polyseed_data* seed) {
+    return polyseed_decode_into_ctx(&polyseed_default_ctx, str, coin,
+        lang_out, seed);
+}
 
-    /* checksum */
-    if (!gf_poly_check(&poly)) {
-        res = POLYSEED_ERR_CHECKSUM;
-        goto cleanup;
-    }
+polyseed_status polyseed_decode_into_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang** lang_out,
+    polyseed_data* seed) {
 
-    /* alocate memory */
-    seed = ALLOC(sizeof(polyseed_data));
+    assert(ctx != NULL);
+    assert(str != NULL);
+    assert((gf_elem)coin < GF_SIZE);
+    assert(seed != NULL);
+    CHECK_DEPS(ctx);
 
-    if (seed == NULL) {
-        res = POLYSEED_ERR_MEMORY;
-        goto cleanup;
-    }
+    return decode_phrase(ctx, str, strlen(str), coin, NULL, lang_out, seed);
+}
 
-    /* decode polynomial into seed data */
-    polyseed_poly_to_data(&poly, seed);
+polyseed_status polyseed_decode_explicit(const char* str, polyseed_coin coin,
+    const polyseed_lang* lang, polyseed_data** seed_out) {
 
-    /* check features */
-    if (!polyseed_features_supported(seed->features)) {
-        polyseed_free(seed);
-        res = POLYSEED_ERR_UNSUPPORTED;
-        goto cleanup;
-    }
+    assert(str != NULL);
+    return polyseed_decode_explicit_n_ctx(&polyseed_default_ctx, str,
+        strlen(str), coin, lang, seed_out);
+}
 
-    *seed_out = seed;
-    res = POLYSEED_OK;
+polyseed_status polyseed_decode_explicit_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang* lang,
+    polyseed_data** seed_out) {
 
-cleanup:
-    MEMZERO_LOC(str_tmp);
-    MEMZERO_LOC(words);
-    MEMZERO_LOC(poly);
-    return res;
+    assert(str != NULL);
+    return polyseed_decode_explicit_n_ctx(ctx, str, strlen(str), coin, lang,
+        seed_out);
 }
 
-polyseed_status polyseed_decode_explicit(const char* str, polyseed_coin coin,
+polyseed_status polyseed_decode_explicit_n(const char* str, size_t length,
+    polyseed_coin coin, const polyseed_lang* lang, polyseed_data** seed_out) {
+    return polyseed_decode_explicit_n_ctx(&polyseed_default_ctx, str, length,
+        coin, lang, seed_out);
+}
+
+polyseed_status polyseed_decode_explicit_n_ctx(const polyseed_context* ctx,
+    const char* str, size_t length, polyseed_coin coin,
     const polyseed_lang* lang, polyseed_data** seed_out) {
 
+    assert(ctx != NULL);
     assert(str != NULL);
     assert((gf_elem)coin < GF_SIZE);
     assert(lang != NULL);
     assert(seed_out != NULL);
-    CHECK_DEPS();
+    CHECK_DEPS(ctx);
 
-    polyseed_str str_tmp;
-    polyseed_phrase words;
-    gf_poly poly = { 0 };
-    polyseed_status res;
-    polyseed_data* seed;
-
-    /* canonical decomposition */
-    size_t str_size = UTF8_DECOMPOSE(str, str_tmp);
-    assert(str_size < POLYSEED_STR_SIZE);
-
-    /* split into words */
-    if (str_split(str_tmp, words) != POLYSEED_NUM_WORDS) {
-        res = POLYSEED_ERR_NUM_WORDS;
-        goto cleanup;
+    polyseed_data data;
+    polyseed_status res = decode_phrase(ctx, str, length, coin, lang, NULL, &data);
+    if (res != POLYSEED_OK) {
+        return res;
     }
+    return alloc_seed(ctx, &data, seed_out);
+}
 
-    /* decode words into polynomial coefficients */
-    res = polyseed_phrase_decode_explicit(words, lang, poly.coeff);
+polyseed_status polyseed_decode_explicit_into(const char* str,
+    polyseed_coin coin, const polyseed_lang* lang, polyseed_data* seed) {
+    return polyseed_decode_explicit_into_ctx(&polyseed_default_ctx, str, coin,
+        lang, seed);
+}
 
-    if (res != POLYSEED_OK) {
-        goto cleanup;
-    }
+polyseed_status polyseed_decode_explicit_into_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang* lang,
+    polyseed_data* seed) {
 
-    /* finalize polynomial */
-    poly.coeff[POLY_NUM_CHECK_DIGITS] ^= coin;
+    assert(ctx != NULL);
+    assert(str != NULL);
+    assert((gf_elem)coin < GF_SIZE);
+    assert(lang != NULL);
+    assert(seed != NULL);
+    CHECK_DEPS(ctx);
 
-    /* checksum */
-    if (!gf_poly_check(&poly)) {
-        res = POLYSEED_ERR_CHECKSUM;
-        goto cleanup;
-    }
+    return decode_phrase(ctx, str, strlen(str), coin, lang, NULL, seed);
+}
 
-    /* alocate memory */
-    seed = ALLOC(sizeof(polyseed_data));
+polyseed_status polyseed_decode_storage(const char* str, polyseed_coin coin,
+    const polyseed_lang** lang_out, polyseed_storage storage) {
+    return polyseed_decode_storage_ctx(&polyseed_default_ctx, str, coin,
+        lang_out, storage);
+}
 
-    if (seed == NULL) {
-        res = POLYSEED_ERR_MEMORY;
-        goto cleanup;
+polyseed_status polyseed_decode_storage_ctx(const polyseed_context* ctx,
+    const char* str, polyseed_coin coin, const polyseed_lang** lang_out,
+    polyseed_storage storage) {
+
+    assert(ctx != NULL);
+    assert(str != NULL);
+    assert((gf_elem)coin < GF_SIZE);
+    assert(storage != NULL);
+    CHECK_DEPS(ctx);
+
+    polyseed_data data;
+    polyseed_status res = decode_phrase(ctx, str, strlen(str), coin, NULL,
+        lang_out, &data);
+    if (res == POLYSEED_OK) {
+        polyseed_data_store(&data, storage);
+        MEMZERO_LOC(ctx, data);
     }
+    return res;
+}
 
-    /* decode polynomial into seed data */
-    polyseed_poly_to_data(&poly, seed);
+size_t polyseed_decode_batch(const char* buffer, const size_t* offsets,
+    size_t count, polyseed_coin coin, polyseed_status* status_out,
+    const polyseed_lang** lang_out, polyseed_storage* storage_out) {
+    return polyseed_decode_batch_ctx(&polyseed_default_ctx, buffer, offsets,
+        count, coin, status_out, lang_out, storage_out);
+}
 
-    /* check features */
-    if (!polyseed_features_supported(seed->features)) {
-        polyseed_free(seed);
-        res = POLYSEED_ERR_UNSUPPORTED;
-        goto cleanup;
-    }
+size_t polyseed_decode_batch_ctx(const polyseed_context* ctx,
+    const char* buffer, const size_t* offsets, size_t count,
+    polyseed_coin coin, polyseed_status* status_out,
+    const polyseed_lang** lang_out, polyseed_storage* storage_out) {
 
-    *seed_out = seed;
-    res = POLYSEED_OK;
+    assert(ctx != NULL);
+    assert(buffer != NULL || count == 0);
+    assert(offsets != NULL);
+    assert((gf_elem)coin < GF_SIZE);
+    assert(status_out != NULL || count == 0);
+    assert(storage_out != NULL || count == 0);
+    CHECK_DEPS(ctx);
+
+    /* the working memory is shared by all phrases and erased once */
+    decode_state state;
+    polyseed_data data;
+    size_t num_decoded = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        assert(offsets[i] <= offsets[i + 1]);
+        const polyseed_lang* lang = NULL;
+        polyseed_status res = decode_phrase_state(ctx, &state,
+            buffer + offsets[i], offsets[i + 1] - offsets[i], coin, NULL,
+            &lang, &data);
+        if (res == POLYSEED_OK) {
+            polyseed_data_store(&data, storage_out[i]);
+            num_decoded++;
+        }
+        else {
+            memset(storage_out[i], 0, sizeof(polyseed_storage));
+            lang = NULL;
+        }
+        status_out[i] = res;
+        if (lang_out != NULL) {
+            lang_out[i] = lang;
+        }
+    }
 
-cleanup:
-    MEMZERO_LOC(str_tmp);
-    MEMZERO_LOC(words);
-    MEMZERO_LOC(poly);
-    return res;
+    MEMZERO_LOC(ctx, state);
+    MEMZERO_LOC(ctx, data);
+    return num_decoded;
 }
 
 static inline void store32(uint8_t* p, uint32_t u) {
@@ -305,24 +663,190 @@ static inline void store32(uint8_t* p, uint32_t u) {
     *p++ = (uint8_t)u;
 }
 
-void polyseed_keygen(const polyseed_data* seed, polyseed_coin coin,
-    size_t key_size, uint8_t* key_out) {
+#define KEYGEN_SALT_SIZE 32
 
-    assert(seed != NULL);
-    assert((gf_elem)coin < GF_SIZE);
-    assert(key_out != NULL);
-    CHECK_DEPS();
+/* Number of keys derived with one call to pbkdf2_sha256_multi */
+#define KEYGEN_BATCH_CHUNK 16
 
-    uint8_t salt[32] = "POLYSEED key";
+/* Keyed HMAC state of the hmac_sha256_init dependency */
+typedef union hmac_state {
+    uint8_t bytes[POLYSEED_HMAC_STATE_SIZE];
+    uint64_t align;
+    void* align_ptr;
+} hmac_state;
+
+static void keygen_salt(const polyseed_data* seed, polyseed_coin coin,
+    uint8_t salt[KEYGEN_SALT_SIZE]) {
+    memset(salt, 0, KEYGEN_SALT_SIZE);
+    memcpy(salt, "POLYSEED key", 12);
     salt[13] = 0xff;
     salt[14] = 0xff;
     salt[15] = 0xff;
     store32(&salt[16], coin);           /* domain separate by coin */
     store32(&salt[20], seed->birthday); /* domain separate by birthday */
     store32(&salt[24], seed->features); /* domain separate by features */
-    
-    PBKDF2_SHA256(seed->secret, SECRET_BUFFER_SIZE, salt, sizeof(salt),
+}
+
+void polyseed_keygen(const polyseed_data* seed, polyseed_coin coin,
+    size_t key_size, uint8_t* key_out) {
+    polyseed_keygen_ctx(&polyseed_default_ctx, seed, coin, key_size, key_out);
+}
+
+void polyseed_keygen_ctx(const polyseed_context* ctx,
+    const polyseed_data* seed, polyseed_coin coin, size_t key_size,
+    uint8_t* key_out) {
+
+    assert(ctx != NULL);
+    assert(seed != NULL);
+    assert((gf_elem)coin < GF_SIZE);
+    assert(key_out != NULL);
+    CHECK_DEPS(ctx);
+
+    if (ctx->keygen_cache && polyseed_keycache_get(seed,
+        ctx->deps.pbkdf2_sha256, coin, key_size, key_out)) {
+        return;
+    }
+
+    uint8_t salt[KEYGEN_SALT_SIZE];
+    keygen_salt(seed, coin, salt);
+
+    PBKDF2_SHA256(ctx, seed->secret, SECRET_BUFFER_SIZE, salt, sizeof(salt),
         KDF_NUM_ITERATIONS, key_out, key_size);
+
+    if (ctx->keygen_cache) {
+        polyseed_keycache_put(seed, ctx->deps.pbkdf2_sha256, coin, key_size,
+            key_out);
+    }
+}
+
+/* Keys derived with one call to pbkdf2_sha256_multi */
+typedef struct keygen_chunk {
+    size_t count;
+    const polyseed_data* seeds[KEYGEN_BATCH_CHUNK];
+    polyseed_coin coins[KEYGEN_BATCH_CHUNK];
+    uint8_t salts[KEYGEN_BATCH_CHUNK][KEYGEN_SALT_SIZE];
+    const uint8_t* pw[KEYGEN_BATCH_CHUNK];
+    const uint8_t* salt[KEYGEN_BATCH_CHUNK];
+    uint8_t* key[KEYGEN_BATCH_CHUNK];
+} keygen_chunk;
+
+static void keygen_chunk_run(const polyseed_context* ctx,
+    keygen_chunk* chunk, size_t key_size) {
+    ctx->deps.pbkdf2_sha256_multi(chunk->count, chunk->pw,
+        SECRET_BUFFER_SIZE, chunk->salt, KEYGEN_SALT_SIZE, KDF_NUM_ITERATIONS,
+        chunk->key, key_size);
+    if (ctx->keygen_cache) {
+        /* the keys are the same as the keys derived by pbkdf2_sha256 */
+        for (size_t j = 0; j < chunk->count; ++j) {
+            polyseed_keycache_put(chunk->seeds[j], ctx->deps.pbkdf2_sha256,
+                chunk->coins[j], key_size, chunk->key[j]);
+        }
+    }
+    chunk->count = 0;
+}
+
+void polyseed_keygen_batch(const polyseed_data* const* seeds,
+    const polyseed_coin* coins, size_t count, size_t key_size,
+    uint8_t* keys_out) {
+    polyseed_keygen_batch_ctx(&polyseed_default_ctx, seeds, coins, count,
+        key_size, keys_out);
+}
+
+void polyseed_keygen_batch_ctx(const polyseed_context* ctx,
+    const polyseed_data* const* seeds, const polyseed_coin* coins,
+    size_t count, size_t key_size, uint8_t* keys_out) {
+
+    assert(ctx != NULL);
+    assert(seeds != NULL || count == 0);
+    assert(coins != NULL || count == 0);
+    assert(keys_out != NULL || count == 0);
+    CHECK_DEPS(ctx);
+
+    if (ctx->deps.pbkdf2_sha256_multi == NULL) {
+        for (size_t i = 0; i < count; ++i) {
+            polyseed_keygen_ctx(ctx, seeds[i], coins[i], key_size,
+                &keys_out[i * key_size]);
+        }
+        return;
+    }
+
+    keygen_chunk chunk;
+    chunk.count = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        const polyseed_data* seed = seeds[i];
+        uint8_t* key_out = &keys_out[i * key_size];
+        assert(seed != NULL);
+        assert((gf_elem)coins[i] < GF_SIZE);
+        /* cached keys are not derived again, same as in polyseed_keygen */
+        if (ctx->keygen_cache && polyseed_keycache_get(seed,
+            ctx->deps.pbkdf2_sha256, coins[i], key_size, key_out)) {
+            continue;
+        }
+        size_t j = chunk.count++;
+        chunk.seeds[j] = seed;
+        chunk.coins[j] = coins[i];
+        keygen_salt(seed, coins[i], chunk.salts[j]);
+        chunk.pw[j] = seed->secret;
+        chunk.salt[j] = chunk.salts[j];
+        chunk.key[j] = key_out;
+        if (chunk.count == KEYGEN_BATCH_CHUNK) {
+            keygen_chunk_run(ctx, &chunk, key_size);
+        }
+    }
+    if (chunk.count > 0) {
+        keygen_chunk_run(ctx, &chunk, key_size);
+    }
+}
+
+void polyseed_keygen_multi(const polyseed_data* seed,
+    const polyseed_coin* coins, size_t count, size_t key_size,
+    uint8_t* keys_out) {
+    polyseed_keygen_multi_ctx(&polyseed_default_ctx, seed, coins, count,
+        key_size, keys_out);
+}
+
+void polyseed_keygen_multi_ctx(const polyseed_context* ctx,
+    const polyseed_data* seed, const polyseed_coin* coins, size_t count,
+    size_t key_size, uint8_t* keys_out) {
+
+    assert(ctx != NULL);
+    assert(seed != NULL);
+    assert(coins != NULL || count == 0);
+    assert(keys_out != NULL || count == 0);
+    CHECK_DEPS(ctx);
+
+    if (ctx->deps.hmac_sha256_init == NULL ||
+        ctx->deps.pbkdf2_sha256_hmac == NULL) {
+        for (size_t i = 0; i < count; ++i) {
+            polyseed_keygen_ctx(ctx, seed, coins[i], key_size,
+                &keys_out[i * key_size]);
+        }
+        return;
+    }
+
+    /* the password is the same for all coins */
+    hmac_state state;
+    ctx->deps.hmac_sha256_init(seed->secret, SECRET_BUFFER_SIZE, &state);
+
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t* key_out = &keys_out[i * key_size];
+        assert((gf_elem)coins[i] < GF_SIZE);
+        if (ctx->keygen_cache && polyseed_keycache_get(seed,
+            ctx->deps.pbkdf2_sha256, coins[i], key_size, key_out)) {
+            continue;
+        }
+        uint8_t salt[KEYGEN_SALT_SIZE];
+        keygen_salt(seed, coins[i], salt);
+        ctx->deps.pbkdf2_sha256_hmac(&state, salt, sizeof(salt),
+            KDF_NUM_ITERATIONS, key_out, key_size);
+        if (ctx->keygen_cache) {
+            polyseed_keycache_put(seed, ctx->deps.pbkdf2_sha256, coins[i],
+                key_size, key_out);
+        }
+    }
+
+    MEMZERO_LOC(ctx, state);
 }
 
 void polyseed_store(const polyseed_data* seed, polyseed_storage storage) {
@@ -334,95 +858,351 @@ void polyseed_store(const polyseed_data* seed, polyseed_storage storage) {
 
 polyseed_status polyseed_load(const polyseed_storage storage,
     polyseed_data** seed_out) {
+    return polyseed_load_ctx(&polyseed_default_ctx, storage, seed_out);
+}
 
+polyseed_status polyseed_load_ctx(const polyseed_context* ctx,
+    const polyseed_storage storage, polyseed_data** seed_out) {
+
+    assert(ctx != NULL);
     assert(storage != NULL);
     assert(seed_out != NULL);
 
-    gf_poly poly = { 0 };
-    polyseed_status res;
-    polyseed_data* seed;
-
-    /* alocate memory */
-    seed = ALLOC(sizeof(polyseed_data));
-
-    if (seed == NULL) {
-        return POLYSEED_ERR_MEMORY;
-    }
-
-    /* deserialize data */
-    res = polyseed_data_load(storage, seed);
+    polyseed_data data;
+    polyseed_status res = load_seed(ctx, storage, &data);
     if (res != POLYSEED_OK) {
-        polyseed_free(seed);
         return res;
     }
+    return alloc_seed(ctx, &data, seed_out);
+}
 
-    /* encode polynomial with the existing checksum */
-    poly.coeff[0] = seed->checksum;
-    polyseed_data_to_poly(seed, &poly);
-
-    /* checksum */
-    if (!gf_poly_check(&poly)) {
-        polyseed_free(seed);
-        res = POLYSEED_ERR_CHECKSUM;
-        goto cleanup;
-    }
+polyseed_status polyseed_load_into(const polyseed_storage storage,
+    polyseed_data* seed) {
+    return polyseed_load_into_ctx(&polyseed_default_ctx, storage, seed);
+}
 
-    /* check features */
-    if (!polyseed_features_supported(seed->features)) {
-        polyseed_free(seed);
-        res = POLYSEED_ERR_UNSUPPORTED;
-        goto cleanup;
-    }
+polyseed_status polyseed_load_into_ctx(const polyseed_context* ctx,
+    const polyseed_storage storage, polyseed_data* seed) {
 
-    res = POLYSEED_OK;
-    *seed_out = seed;
+    assert(ctx != NULL);
+    assert(storage != NULL);
+    assert(seed != NULL);
 
-cleanup:
-    MEMZERO_LOC(poly);
-    return res;
+    return load_seed(ctx, storage, seed);
 }
 
-void polyseed_crypt(polyseed_data* seed, const char* password) {
-    assert(seed != NULL);
-    assert(password != NULL);
+/* Encryption mask derived from a password */
+struct polyseed_mask {
+    uint8_t bytes[32];
+};
+
+static void derive_mask(const polyseed_context* ctx, const char* password,
+    size_t length, polyseed_mask* mask) {
 
     polyseed_str pass_norm;
 
     /* normalize password */
-    size_t str_size = UTF8_DECOMPOSE(password, pass_norm);
+    size_t str_size;
+    length = str_length(password, length);
+    const char* pass = UTF8_DECOMPOSE(ctx, password, length, pass_norm, &str_size);
+    if (pass == NULL) {
+        /* passwords that are not valid UTF-8 are passed to the injected
+           function as before to derive the same mask */
+        str_size = UTF8_DECOMPOSE_ANY(ctx, password, length, pass_norm);
+        pass = pass_norm;
+    }
     assert(str_size < POLYSEED_STR_SIZE);
 
     /* derive an encryption mask */
-    uint8_t mask[32];
-
     char salt[16] = "POLYSEED mask";
     salt[14] = 0xff;
     salt[15] = 0xff;
 
-    PBKDF2_SHA256(pass_norm, str_size, salt, sizeof(salt),
-        KDF_NUM_ITERATIONS, mask, sizeof(mask));
+    PBKDF2_SHA256(ctx, (const uint8_t*)pass, str_size, (const uint8_t*)salt,
+        sizeof(salt), KDF_NUM_ITERATIONS, mask->bytes, sizeof(mask->bytes));
+
+    MEMZERO_LOC(ctx, pass_norm);
+}
+
+/* Encrypts or decrypts the seed. poly is used as working memory. */
+static void apply_mask(polyseed_data* seed, const polyseed_mask* mask,
+    gf_poly* poly) {
 
     /* apply mask */
     for (int i = 0; i < SECRET_SIZE; ++i) {
-        seed->secret[i] ^= mask[i];
+        seed->secret[i] ^= mask->bytes[i];
     }
     seed->secret[SECRET_SIZE - 1] &= CLEAR_MASK;
 
     seed->features ^= ENCRYPTED_MASK;
 
-    gf_poly poly = { 0 };
-
     /* encode polynomial */
-    polyseed_data_to_poly(seed, &poly);
+    memset(poly, 0, sizeof(gf_poly));
+    polyseed_data_to_poly(seed, poly);
 
     /* calculate new checksum */
-    gf_poly_encode(&poly);
+    gf_poly_encode(poly);
 
-    seed->checksum = poly.coeff[0];
+    seed->checksum = poly->coeff[0];
+}
+
+void polyseed_crypt(polyseed_data* seed, const char* password) {
+    assert(password != NULL);
+    polyseed_crypt_n_ctx(&polyseed_default_ctx, seed, password,
+        strlen(password));
+}
+
+void polyseed_crypt_ctx(const polyseed_context* ctx, polyseed_data* seed,
+    const char* password) {
+    assert(password != NULL);
+    polyseed_crypt_n_ctx(ctx, seed, password, strlen(password));
+}
+
+void polyseed_crypt_n(polyseed_data* seed, const char* password,
+    size_t length) {
+    polyseed_crypt_n_ctx(&polyseed_default_ctx, seed, password, length);
+}
+
+void polyseed_crypt_n_ctx(const polyseed_context* ctx, polyseed_data* seed,
+    const char* password, size_t length) {
+    assert(ctx != NULL);
+    assert(seed != NULL);
+    assert(password != NULL);
+
+    polyseed_mask mask;
+    gf_poly poly;
+
+    derive_mask(ctx, password, length, &mask);
+    apply_mask(seed, &mask, &poly);
+
+    MEMZERO_LOC(ctx, poly);
+    MEMZERO_LOC(ctx, mask);
+}
 
-    MEMZERO_LOC(poly);
-    MEMZERO_LOC(mask);
-    MEMZERO_LOC(pass_norm);
+polyseed_status polyseed_mask_derive(const char* password, size_t length,
+    polyseed_mask** mask_out) {
+    return polyseed_mask_derive_ctx(&polyseed_default_ctx, password, length,
+        mask_out);
+}
+
+polyseed_status polyseed_mask_derive_ctx(const polyseed_context* ctx,
+    const char* password, size_t length, polyseed_mask** mask_out) {
+    assert(ctx != NULL);
+    assert(password != NULL);
+    assert(mask_out != NULL);
+    CHECK_DEPS(ctx);
+
+    polyseed_mask* mask = ALLOC(ctx, sizeof(polyseed_mask));
+    if (mask == NULL) {
+        return POLYSEED_ERR_MEMORY;
+    }
+    derive_mask(ctx, password, length, mask);
+
+    *mask_out = mask;
+    return POLYSEED_OK;
+}
+
+void polyseed_mask_free(polyseed_mask* mask) {
+    polyseed_mask_free_ctx(&polyseed_default_ctx, mask);
+}
+
+void polyseed_mask_free_ctx(const polyseed_context* ctx, polyseed_mask* mask) {
+    assert(ctx != NULL);
+    if (mask != NULL) {
+        MEMZERO_PTR(ctx, mask, polyseed_mask);
+        FREE(ctx, mask);
+    }
+}
+
+void polyseed_crypt_with_mask(polyseed_data* seed, const polyseed_mask* mask) {
+    polyseed_crypt_with_mask_ctx(&polyseed_default_ctx, seed, mask);
+}
+
+void polyseed_crypt_with_mask_ctx(const polyseed_context* ctx,
+    polyseed_data* seed, const polyseed_mask* mask) {
+    polyseed_crypt_batch_with_mask_ctx(ctx, &seed, 1, mask);
+}
+
+void polyseed_crypt_batch_with_mask(polyseed_data* const* seeds, size_t count,
+    const polyseed_mask* mask) {
+    polyseed_crypt_batch_with_mask_ctx(&polyseed_default_ctx, seeds, count,
+        mask);
+}
+
+void polyseed_crypt_batch_with_mask_ctx(const polyseed_context* ctx,
+    polyseed_data* const* seeds, size_t count, const polyseed_mask* mask) {
+    assert(ctx != NULL);
+    assert(seeds != NULL || count == 0);
+    assert(mask != NULL);
+
+    gf_poly poly;
+
+    for (size_t i = 0; i < count; ++i) {
+        assert(seeds[i] != NULL);
+        apply_mask(seeds[i], mask, &poly);
+    }
+
+    MEMZERO_LOC(ctx, poly);
+}
+
+/* Number of records rotated by one worker job */
+#define ROTATE_CHUNK 1024
+
+/* Maximum number of worker jobs in flight */
+#define ROTATE_MAX_JOBS 64
+
+/* Number of records rotated at a time by the calling thread when the
+   scratch space is on the stack */
+#define ROTATE_LOCAL 256
+
+/* Range of records rotated by one worker job */
+typedef struct rotate_job {
+    const polyseed_context* ctx;
+    const polyseed_mask* mask;
+    const polyseed_storage* records;
+    /* rotated records of the range, copied to the output by the caller */
+    polyseed_storage* scratch;
+    size_t begin;
+    size_t end;
+    /* index of the first record that failed to rotate or end */
+    size_t failed;
+    polyseed_status status;
+} rotate_job;
+
+static void rotate_range(void* arg) {
+    rotate_job* job = arg;
+    const polyseed_context* ctx = job->ctx;
+    polyseed_data data;
+    size_t i;
+
+    job->status = POLYSEED_OK;
+    for (i = job->begin; i < job->end; ++i) {
+        polyseed_status res = load_seed(ctx, job->records[i], &data);
+        if (res == POLYSEED_OK && !is_encrypted(data.features)) {
+            res = POLYSEED_ERR_NOT_ENCRYPTED;
+        }
+        if (res != POLYSEED_OK) {
+            job->status = res;
+            break;
+        }
+        /* decrypt and encrypt in one step */
+        for (int j = 0; j < SECRET_SIZE; ++j) {
+            data.secret[j] ^= job->mask->bytes[j];
+        }
+        seed_finalize(ctx, &data);
+        polyseed_data_store(&data, job->scratch[i - job->begin]);
+    }
+    job->failed = i;
+
+    MEMZERO_LOC(ctx, data);
+}
+
+polyseed_status polyseed_rotate(const polyseed_mask* old_mask,
+    const polyseed_mask* new_mask, const polyseed_storage* records,
+    polyseed_storage* records_out, size_t count, size_t* cursor) {
+    return polyseed_rotate_ctx(&polyseed_default_ctx, old_mask, new_mask,
+        records, records_out, count, cursor);
+}
+
+polyseed_status polyseed_rotate_ctx(const polyseed_context* ctx,
+    const polyseed_mask* old_mask, const polyseed_mask* new_mask,
+    const polyseed_storage* records, polyseed_storage* records_out,
+    size_t count, size_t* cursor) {
+
+    assert(ctx != NULL);
+    assert(old_mask != NULL);
+    assert(new_mask != NULL);
+    assert(records != NULL || count == 0);
+    assert(records_out != NULL || count == 0);
+    assert(cursor != NULL);
+    assert(*cursor <= count);
+    CHECK_DEPS(ctx);
+
+    /* the combined mask of both passwords */
+    polyseed_mask mask;
+    for (size_t i = 0; i < sizeof(mask.bytes); ++i) {
+        mask.bytes[i] = old_mask->bytes[i] ^ new_mask->bytes[i];
+    }
+
+    rotate_job jobs[ROTATE_MAX_JOBS];
+    polyseed_job* handles[ROTATE_MAX_JOBS];
+    polyseed_status res = POLYSEED_OK;
+
+    /* records are rotated into scratch space, so that the output after
+       a failed record is left unchanged even if other jobs succeeded.
+       Large batches use locked pages; small batches and platforms without
+       virtual memory use a stack buffer without worker jobs. */
+    polyseed_storage local[ROTATE_LOCAL];
+    size_t scratch_count = count - *cursor;
+    if (scratch_count > ROTATE_MAX_JOBS * ROTATE_CHUNK) {
+        scratch_count = ROTATE_MAX_JOBS * ROTATE_CHUNK;
+    }
+    size_t scratch_size = scratch_count * sizeof(polyseed_storage);
+    polyseed_storage* scratch = NULL;
+    if (scratch_count > ROTATE_LOCAL) {
+        scratch = polyseed_secure_pages(scratch_size);
+    }
+    size_t chunk = ROTATE_CHUNK;
+    size_t max_jobs = ROTATE_MAX_JOBS;
+    if (scratch == NULL) {
+        chunk = ROTATE_LOCAL;
+        max_jobs = 1;
+    }
+
+    while (res == POLYSEED_OK && *cursor < count) {
+        size_t num_jobs = (count - *cursor + chunk - 1) / chunk;
+        if (num_jobs > max_jobs) {
+            num_jobs = max_jobs;
+        }
+        for (size_t i = 0; i < num_jobs; ++i) {
+            rotate_job* job = &jobs[i];
+            job->ctx = ctx;
+            job->mask = &mask;
+            job->records = records;
+            job->scratch = scratch != NULL ? &scratch[i * chunk] : local;
+            job->begin = *cursor + i * chunk;
+            job->end = job->begin + chunk;
+            if (job->end > count) {
+                job->end = count;
+            }
+        }
+
+        /* the first range is rotated by the calling thread and so are
+           the ranges that cannot be queued */
+        for (size_t i = 1; i < num_jobs; ++i) {
+            if (polyseed_async_run(ctx, &rotate_range, &jobs[i], &handles[i])
+                != POLYSEED_OK) {
+                handles[i] = NULL;
+                rotate_range(&jobs[i]);
+            }
+        }
+        rotate_range(&jobs[0]);
+
+        for (size_t i = 1; i < num_jobs; ++i) {
+            if (handles[i] != NULL) {
+                (void)polyseed_job_wait(handles[i]);
+                polyseed_job_free(handles[i]);
+            }
+        }
+
+        /* only the records before the first failure are written and
+           the cursor stops at that record */
+        for (size_t i = 0; i < num_jobs && res == POLYSEED_OK; ++i) {
+            const rotate_job* job = &jobs[i];
+            memcpy(&records_out[job->begin], job->scratch,
+                (job->failed - job->begin) * sizeof(polyseed_storage));
+            *cursor = job->failed;
+            res = job->status;
+        }
+    }
+
+    if (scratch != NULL) {
+        ctx->deps.memzero(scratch, scratch_size);
+        polyseed_secure_pages_free(scratch, scratch_size);
+    }
+    MEMZERO_LOC(ctx, local);
+    MEMZERO_LOC(ctx, mask);
+    return res;
 }
 
 int polyseed_is_encrypted(const polyseed_data* seed) {
@@ -0,0 +1,254 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, madvise */
+#endif
+
+#include "polyseed.h"
+#include "storage.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Platforms without virtual memory use a static arena */
+#if defined(POLYSEED_SLAB_ARENA)
+#elif defined(_WIN32)
+#define SLAB_PAGES_WIN32
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#define SLAB_PAGES_MMAP
+#include <sys/mman.h>
+#else
+#define POLYSEED_SLAB_ARENA
+#endif
+
+/* Seeds are stored in fixed-size slots. Each slab has SLAB_SLOTS slots
+   followed by the free list links of the slots. Slabs are allocated on
+   demand and never released. */
+#define SLOT_SIZE 64
+#define SLAB_SLOTS 1024
+#define SLAB_SLOTS_SIZE (SLAB_SLOTS * SLOT_SIZE)
+#define SLAB_SIZE (SLAB_SLOTS_SIZE + SLAB_SLOTS * sizeof(uint32_t))
+
+#ifdef POLYSEED_SLAB_ARENA
+#ifndef POLYSEED_SLAB_ARENA_SLABS
+#define POLYSEED_SLAB_ARENA_SLABS 1
+#endif
+#define SLAB_MAX POLYSEED_SLAB_ARENA_SLABS
+#else
+#define SLAB_MAX 64
+#endif
+
+static_assert(sizeof(polyseed_data) <= SLOT_SIZE, "slot too small");
+
+static unsigned char* _Atomic g_slabs[SLAB_MAX];
+static atomic_uint g_num_slabs;
+
+/* Placeholder of a slab that is being allocated */
+static unsigned char g_slab_pending;
+#define SLAB_PENDING (&g_slab_pending)
+
+/* Free list of all slots. Slots are identified by their global index
+   plus one (zero marks the end of the list). The upper half of the head
+   is a counter that is incremented by every update to avoid ABA. */
+static _Atomic uint64_t g_free_head;
+
+#ifdef POLYSEED_SLAB_ARENA
+static _Alignas(SLOT_SIZE) unsigned char g_arena[SLAB_MAX][SLAB_SIZE];
+
+static unsigned char* pages_alloc(unsigned slab) {
+    return g_arena[slab];
+}
+
+POLYSEED_PRIVATE void* polyseed_secure_pages(size_t size) {
+    (void)size;
+    return NULL;
+}
+
+POLYSEED_PRIVATE void polyseed_secure_pages_free(void* ptr, size_t size) {
+    (void)ptr;
+    (void)size;
+}
+#else
+#if defined(SLAB_PAGES_WIN32)
+static unsigned char* pages_map(size_t size) {
+    void* mem = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE,
+        PAGE_READWRITE);
+    if (mem == NULL) {
+        return NULL;
+    }
+    /* best effort: limited by the working set size */
+    (void)VirtualLock(mem, size);
+    return mem;
+}
+
+static void pages_unmap(void* mem, size_t size) {
+    (void)size;
+    (void)VirtualFree(mem, 0, MEM_RELEASE);
+}
+#else
+static unsigned char* pages_map(size_t size) {
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+#if defined(MADV_DONTDUMP)
+    (void)madvise(mem, size, MADV_DONTDUMP);
+#elif defined(MADV_NOCORE)
+    (void)madvise(mem, size, MADV_NOCORE);
+#endif
+    /* best effort: limited by RLIMIT_MEMLOCK */
+    (void)mlock(mem, size);
+    return mem;
+}
+
+static void pages_unmap(void* mem, size_t size) {
+    (void)munmap(mem, size);
+}
+#endif
+
+static unsigned char* pages_alloc(unsigned slab) {
+    (void)slab;
+    return pages_map(SLAB_SIZE);
+}
+
+POLYSEED_PRIVATE void* polyseed_secure_pages(size_t size) {
+    return pages_map(size);
+}
+
+POLYSEED_PRIVATE void polyseed_secure_pages_free(void* ptr, size_t size) {
+    if (ptr != NULL) {
+        pages_unmap(ptr, size);
+    }
+}
+#endif
+
+static _Atomic uint32_t* slot_link(uint32_t id) {
+    uint32_t index = id - 1;
+    unsigned char* slab = atomic_load_explicit(&g_slabs[index / SLAB_SLOTS],
+        memory_order_relaxed);
+    _Atomic uint32_t* links = (_Atomic uint32_t*)(slab + SLAB_SLOTS_SIZE);
+    return &links[index % SLAB_SLOTS];
+}
+
+static void free_list_push(uint32_t first, uint32_t last) {
+    uint64_t head = atomic_load_explicit(&g_free_head, memory_order_relaxed);
+    uint64_t next;
+    do {
+        atomic_store_explicit(slot_link(last), (uint32_t)head,
+            memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | first;
+    } while (!atomic_compare_exchange_weak_explicit(&g_free_head, &head,
+        next, memory_order_release, memory_order_relaxed));
+}
+
+static uint32_t free_list_pop(void) {
+    uint64_t head = atomic_load_explicit(&g_free_head, memory_order_acquire);
+    uint64_t next;
+    uint32_t id;
+    do {
+        id = (uint32_t)head;
+        if (id == 0) {
+            return 0;
+        }
+        /* the slot may have been taken by another thread, in which case
+           the counter has changed and the exchange fails */
+        uint32_t link = atomic_load_explicit(slot_link(id),
+            memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | link;
+    } while (!atomic_compare_exchange_weak_explicit(&g_free_head, &head,
+        next, memory_order_acquire, memory_order_acquire));
+    return id;
+}
+
+static bool slab_grow(void) {
+    /* claim the first unused slab, so that the index of a slab whose
+       allocation failed is released and used by the next attempt */
+    unsigned slab = 0;
+    for (;; ++slab) {
+        if (slab == SLAB_MAX) {
+            return false;
+        }
+        unsigned char* expected = NULL;
+        if (atomic_compare_exchange_strong_explicit(&g_slabs[slab], &expected,
+            SLAB_PENDING, memory_order_relaxed, memory_order_relaxed)) {
+            break;
+        }
+    }
+
+    unsigned char* mem = pages_alloc(slab);
+    if (mem == NULL) {
+        atomic_store_explicit(&g_slabs[slab], NULL, memory_order_relaxed);
+        return false;
+    }
+    atomic_store_explicit(&g_slabs[slab], mem, memory_order_relaxed);
+
+    /* the count is published only after a successful allocation */
+    unsigned num_slabs = atomic_load_explicit(&g_num_slabs,
+        memory_order_relaxed);
+    while (num_slabs <= slab && !atomic_compare_exchange_weak_explicit(
+        &g_num_slabs, &num_slabs, slab + 1, memory_order_relaxed,
+        memory_order_relaxed)) {
+    }
+
+    /* link all slots of the new slab and add them to the free list */
+    uint32_t first = slab * SLAB_SLOTS + 1;
+    uint32_t last = first + SLAB_SLOTS - 1;
+    for (uint32_t id = first; id < last; ++id) {
+        atomic_store_explicit(slot_link(id), id + 1, memory_order_relaxed);
+    }
+    free_list_push(first, last);
+    return true;
+}
+
+static void slot_zero(unsigned char* slot) {
+    volatile unsigned char* p = slot;
+    for (int i = 0; i < SLOT_SIZE; ++i) {
+        p[i] = 0;
+    }
+}
+
+void* polyseed_secure_alloc(size_t n) {
+    if (n > SLOT_SIZE) {
+        return NULL;
+    }
+    uint32_t id;
+    while ((id = free_list_pop()) == 0) {
+        if (!slab_grow()) {
+            return NULL;
+        }
+    }
+    uint32_t index = id - 1;
+    unsigned char* slab = atomic_load_explicit(&g_slabs[index / SLAB_SLOTS],
+        memory_order_relaxed);
+    return slab + (index % SLAB_SLOTS) * SLOT_SIZE;
+}
+
+void polyseed_secure_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    uintptr_t addr = (uintptr_t)ptr;
+    unsigned num_slabs = atomic_load_explicit(&g_num_slabs,
+        memory_order_relaxed);
+    for (unsigned slab = 0; slab < num_slabs; ++slab) {
+        unsigned char* mem = atomic_load_explicit(&g_slabs[slab],
+            memory_order_relaxed);
+        uintptr_t base = (uintptr_t)mem;
+        if (mem == NULL || mem == SLAB_PENDING || addr < base ||
+            addr >= base + SLAB_SLOTS_SIZE) {
+            continue;
+        }
+        uint32_t index = (uint32_t)((addr - base) / SLOT_SIZE);
+        assert(addr == base + index * SLOT_SIZE);
+        slot_zero(mem + index * SLOT_SIZE);
+        uint32_t id = slab * SLAB_SLOTS + index + 1;
+        free_list_push(id, id);
+        return;
+    }
+    assert(false); /* not allocated by polyseed_secure_alloc */
+}
@@ -10,7 +10,7 @@
 
 #define SECRET_BUFFER_SIZE 32
 #define SECRET_BITS 150
-#define SECRET_SIZE (SECRET_BITS + CHAR_BIT - 1) / CHAR_BIT /* 19 */
+#define SECRET_SIZE ((SECRET_BITS + CHAR_BIT - 1) / CHAR_BIT) /* 19 */
 #define CLEAR_BITS (SECRET_SIZE) * (CHAR_BIT) - (SECRET_BITS) /* 2 */
 #define CLEAR_MASK ~(uint8_t)(((1u << (CLEAR_BITS)) - 1) << (CHAR_BIT - (CLEAR_BITS)))
 #define TOTAL_BITS GF_BITS * POLYSEED_NUM_WORDS
@@ -31,4 +31,13 @@ POLYSEED_PRIVATE
 polyseed_status polyseed_data_load(const polyseed_storage storage,
     polyseed_data* data);
 
+/* Allocates zeroed memory pages that are locked to RAM and excluded from
+   core dumps where possible. Returns NULL on platforms without virtual
+   memory. */
+POLYSEED_PRIVATE void* polyseed_secure_pages(size_t size);
+
+/* Releases pages allocated by polyseed_secure_pages with the same size.
+   The pages must be erased by the caller. */
+POLYSEED_PRIVATE void polyseed_secure_pages_free(void* ptr, size_t size);
+
 #endif
@@ -0,0 +1,338 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include "unicode.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ASCII_BLOCK_SIZE 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ASCII_BLOCK_SIZE 16
+#else
+#define ASCII_BLOCK_SIZE 8
+#endif
+
+typedef struct unicode_pair {
+    uint16_t composed;
+    uint16_t first;
+    uint16_t second;
+} unicode_pair;
+
+/* Canonical decompositions of lowercase Latin letters with grave, acute,
+   circumflex, tilde, diaeresis, ring, caron and cedilla and of kana with
+   voicing marks. Sorted by the composed character. */
+static const unicode_pair decompositions[] = {
+    { 0x00e0, 0x0061, 0x0300 }, { 0x00e1, 0x0061, 0x0301 },
+    { 0x00e2, 0x0061, 0x0302 }, { 0x00e3, 0x0061, 0x0303 },
+    { 0x00e4, 0x0061, 0x0308 }, { 0x00e5, 0x0061, 0x030a },
+    { 0x00e7, 0x0063, 0x0327 }, { 0x00e8, 0x0065, 0x0300 },
+    { 0x00e9, 0x0065, 0x0301 }, { 0x00ea, 0x0065, 0x0302 },
+    { 0x00eb, 0x0065, 0x0308 }, { 0x00ec, 0x0069, 0x0300 },
+    { 0x00ed, 0x0069, 0x0301 }, { 0x00ee, 0x0069, 0x0302 },
+    { 0x00ef, 0x0069, 0x0308 }, { 0x00f1, 0x006e, 0x0303 },
+    { 0x00f2, 0x006f, 0x0300 }, { 0x00f3, 0x006f, 0x0301 },
+    { 0x00f4, 0x006f, 0x0302 }, { 0x00f5, 0x006f, 0x0303 },
+    { 0x00f6, 0x006f, 0x0308 }, { 0x00f9, 0x0075, 0x0300 },
+    { 0x00fa, 0x0075, 0x0301 }, { 0x00fb, 0x0075, 0x0302 },
+    { 0x00fc, 0x0075, 0x0308 }, { 0x00fd, 0x0079, 0x0301 },
+    { 0x00ff, 0x0079, 0x0308 }, { 0x0107, 0x0063, 0x0301 },
+    { 0x0109, 0x0063, 0x0302 }, { 0x010d, 0x0063, 0x030c },
+    { 0x010f, 0x0064, 0x030c }, { 0x011b, 0x0065, 0x030c },
+    { 0x011d, 0x0067, 0x0302 }, { 0x0123, 0x0067, 0x0327 },
+    { 0x0125, 0x0068, 0x0302 }, { 0x0129, 0x0069, 0x0303 },
+    { 0x0135, 0x006a, 0x0302 }, { 0x0137, 0x006b, 0x0327 },
+    { 0x013a, 0x006c, 0x0301 }, { 0x013c, 0x006c, 0x0327 },
+    { 0x013e, 0x006c, 0x030c }, { 0x0144, 0x006e, 0x0301 },
+    { 0x0146, 0x006e, 0x0327 }, { 0x0148, 0x006e, 0x030c },
+    { 0x0155, 0x0072, 0x0301 }, { 0x0157, 0x0072, 0x0327 },
+    { 0x0159, 0x0072, 0x030c }, { 0x015b, 0x0073, 0x0301 },
+    { 0x015d, 0x0073, 0x0302 }, { 0x015f, 0x0073, 0x0327 },
+    { 0x0161, 0x0073, 0x030c }, { 0x0163, 0x0074, 0x0327 },
+    { 0x0165, 0x0074, 0x030c }, { 0x0169, 0x0075, 0x0303 },
+    { 0x016f, 0x0075, 0x030a }, { 0x0175, 0x0077, 0x0302 },
+    { 0x0177, 0x0079, 0x0302 }, { 0x017a, 0x007a, 0x0301 },
+    { 0x017e, 0x007a, 0x030c }, { 0x01ce, 0x0061, 0x030c },
+    { 0x01d0, 0x0069, 0x030c }, { 0x01d2, 0x006f, 0x030c },
+    { 0x01d4, 0x0075, 0x030c }, { 0x01e7, 0x0067, 0x030c },
+    { 0x01e9, 0x006b, 0x030c }, { 0x01f0, 0x006a, 0x030c },
+    { 0x01f5, 0x0067, 0x0301 }, { 0x01f9, 0x006e, 0x0300 },
+    { 0x021f, 0x0068, 0x030c }, { 0x0229, 0x0065, 0x0327 },
+    { 0x1e11, 0x0064, 0x0327 }, { 0x1e27, 0x0068, 0x0308 },
+    { 0x1e29, 0x0068, 0x0327 }, { 0x1e31, 0x006b, 0x0301 },
+    { 0x1e3f, 0x006d, 0x0301 }, { 0x1e55, 0x0070, 0x0301 },
+    { 0x1e7d, 0x0076, 0x0303 }, { 0x1e81, 0x0077, 0x0300 },
+    { 0x1e83, 0x0077, 0x0301 }, { 0x1e85, 0x0077, 0x0308 },
+    { 0x1e8d, 0x0078, 0x0308 }, { 0x1e91, 0x007a, 0x0302 },
+    { 0x1e97, 0x0074, 0x0308 }, { 0x1e98, 0x0077, 0x030a },
+    { 0x1e99, 0x0079, 0x030a }, { 0x1ebd, 0x0065, 0x0303 },
+    { 0x1ef3, 0x0079, 0x0300 }, { 0x1ef9, 0x0079, 0x0303 },
+    { 0x304c, 0x304b, 0x3099 }, { 0x304e, 0x304d, 0x3099 },
+    { 0x3050, 0x304f, 0x3099 }, { 0x3052, 0x3051, 0x3099 },
+    { 0x3054, 0x3053, 0x3099 }, { 0x3056, 0x3055, 0x3099 },
+    { 0x3058, 0x3057, 0x3099 }, { 0x305a, 0x3059, 0x3099 },
+    { 0x305c, 0x305b, 0x3099 }, { 0x305e, 0x305d, 0x3099 },
+    { 0x3060, 0x305f, 0x3099 }, { 0x3062, 0x3061, 0x3099 },
+    { 0x3065, 0x3064, 0x3099 }, { 0x3067, 0x3066, 0x3099 },
+    { 0x3069, 0x3068, 0x3099 }, { 0x3070, 0x306f, 0x3099 },
+    { 0x3071, 0x306f, 0x309a }, { 0x3073, 0x3072, 0x3099 },
+    { 0x3074, 0x3072, 0x309a }, { 0x3076, 0x3075, 0x3099 },
+    { 0x3077, 0x3075, 0x309a }, { 0x3079, 0x3078, 0x3099 },
+    { 0x307a, 0x3078, 0x309a }, { 0x307c, 0x307b, 0x3099 },
+    { 0x307d, 0x307b, 0x309a }, { 0x3094, 0x3046, 0x3099 },
+    { 0x309e, 0x309d, 0x3099 }, { 0x30ac, 0x30ab, 0x3099 },
+    { 0x30ae, 0x30ad, 0x3099 }, { 0x30b0, 0x30af, 0x3099 },
+    { 0x30b2, 0x30b1, 0x3099 }, { 0x30b4, 0x30b3, 0x3099 },
+    { 0x30b6, 0x30b5, 0x3099 }, { 0x30b8, 0x30b7, 0x3099 },
+    { 0x30ba, 0x30b9, 0x3099 }, { 0x30bc, 0x30bb, 0x3099 },
+    { 0x30be, 0x30bd, 0x3099 }, { 0x30c0, 0x30bf, 0x3099 },
+    { 0x30c2, 0x30c1, 0x3099 }, { 0x30c5, 0x30c4, 0x3099 },
+    { 0x30c7, 0x30c6, 0x3099 }, { 0x30c9, 0x30c8, 0x3099 },
+    { 0x30d0, 0x30cf, 0x3099 }, { 0x30d1, 0x30cf, 0x309a },
+    { 0x30d3, 0x30d2, 0x3099 }, { 0x30d4, 0x30d2, 0x309a },
+    { 0x30d6, 0x30d5, 0x3099 }, { 0x30d7, 0x30d5, 0x309a },
+    { 0x30d9, 0x30d8, 0x3099 }, { 0x30da, 0x30d8, 0x309a },
+    { 0x30dc, 0x30db, 0x3099 }, { 0x30dd, 0x30db, 0x309a },
+    { 0x30f4, 0x30a6, 0x3099 }, { 0x30f7, 0x30ef, 0x3099 },
+    { 0x30f8, 0x30f0, 0x3099 }, { 0x30f9, 0x30f1, 0x3099 },
+    { 0x30fa, 0x30f2, 0x3099 }, { 0x30fe, 0x30fd, 0x3099 },
+};
+
+#define NUM_DECOMPOSITIONS ((int)(sizeof(decompositions) / sizeof(unicode_pair)))
+
+int32_t polyseed_utf8_next(const char** str, const char* end) {
+    const uint8_t* pos = (const uint8_t*)*str;
+    int32_t cp;
+    int n;
+    if (*str >= end) {
+        return -1;
+    }
+    if (pos[0] < 0x80) {
+        cp = pos[0];
+        n = 0;
+    }
+    else if (pos[0] >= 0xc2 && pos[0] < 0xe0) {
+        cp = pos[0] & 0x1f;
+        n = 1;
+    }
+    else if (pos[0] >= 0xe0 && pos[0] < 0xf0) {
+        cp = pos[0] & 0x0f;
+        n = 2;
+    }
+    else if (pos[0] >= 0xf0 && pos[0] < 0xf5) {
+        cp = pos[0] & 0x07;
+        n = 3;
+    }
+    else {
+        return -1;
+    }
+    if (end - *str <= n) {
+        return -1; /* truncated sequence */
+    }
+    ++pos;
+    for (int i = 0; i < n; ++i, ++pos) {
+        if ((*pos & 0xc0) != 0x80) {
+            return -1;
+        }
+        cp = (cp << 6) | (*pos & 0x3f);
+    }
+    if ((n == 2 && cp < 0x800) || (n == 3 && cp < 0x10000) ||
+        (cp >= 0xd800 && cp < 0xe000) || cp > 0x10ffff) {
+        return -1; /* overlong, surrogate or out of range */
+    }
+    *str = (const char*)pos;
+    return cp;
+}
+
+/* Returns true if the next ASCII_BLOCK_SIZE bytes are all ASCII */
+static inline bool is_ascii_block(const char* str) {
+#if ASCII_BLOCK_SIZE == 32
+    __m256i block = _mm256_loadu_si256((const __m256i*)str);
+    return _mm256_movemask_epi8(block) == 0;
+#elif ASCII_BLOCK_SIZE == 16
+    __m128i block = _mm_loadu_si128((const __m128i*)str);
+    return _mm_movemask_epi8(block) == 0;
+#else
+    uint64_t block;
+    memcpy(&block, str, sizeof(block));
+    return (block & UINT64_C(0x8080808080808080)) == 0;
+#endif
+}
+
+utf8_class polyseed_utf8_check(const char* str, size_t len) {
+    utf8_class result = UTF8_ASCII;
+    size_t i = 0;
+    while (i < len) {
+        if (len - i >= ASCII_BLOCK_SIZE && is_ascii_block(&str[i])) {
+            i += ASCII_BLOCK_SIZE;
+            continue;
+        }
+        /* validate the characters of the block one by one */
+        size_t end = i + ASCII_BLOCK_SIZE;
+        if (end > len) {
+            end = len;
+        }
+        while (i < end) {
+            if ((uint8_t)str[i] < 0x80) {
+                ++i;
+                continue;
+            }
+            const char* pos = &str[i];
+            if (polyseed_utf8_next(&pos, str + len) < 0) {
+                return UTF8_INVALID;
+            }
+            i = pos - str;
+            result = UTF8_MULTIBYTE;
+        }
+    }
+    return result;
+}
+
+size_t polyseed_utf8_put(char* out, int32_t cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xc0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3f));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xe0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+        out[2] = (char)(0x80 | (cp & 0x3f));
+        return 3;
+    }
+    out[0] = (char)(0xf0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    out[3] = (char)(0x80 | (cp & 0x3f));
+    return 4;
+}
+
+int32_t polyseed_compose(int32_t first, int32_t second) {
+    /* L + V */
+    if (first >= HANGUL_L_BASE && first < HANGUL_L_BASE + HANGUL_L_COUNT &&
+        second >= HANGUL_V_BASE && second < HANGUL_V_BASE + HANGUL_V_COUNT) {
+        return HANGUL_S_BASE + (first - HANGUL_L_BASE) * HANGUL_N_COUNT +
+            (second - HANGUL_V_BASE) * HANGUL_T_COUNT;
+    }
+    /* LV + T */
+    if (first >= HANGUL_S_BASE && first < HANGUL_S_BASE + HANGUL_S_COUNT &&
+        (first - HANGUL_S_BASE) % HANGUL_T_COUNT == 0 &&
+        second > HANGUL_T_BASE && second < HANGUL_T_BASE + HANGUL_T_COUNT) {
+        return first + (second - HANGUL_T_BASE);
+    }
+    for (int i = 0; i < NUM_DECOMPOSITIONS; ++i) {
+        const unicode_pair* pair = &decompositions[i];
+        if (pair->first == first && pair->second == second) {
+            return pair->composed;
+        }
+    }
+    return -1;
+}
+
+static int compare_pair(const void* a, const void* b) {
+    int32_t key = *(const int32_t*)a;
+    const unicode_pair* elm = b;
+    return (key > elm->composed) - (key < elm->composed);
+}
+
+bool polyseed_decompose(int32_t cp, int32_t* first, int32_t* second) {
+    const unicode_pair* pair = bsearch(&cp, decompositions,
+        NUM_DECOMPOSITIONS, sizeof(unicode_pair), &compare_pair);
+    if (pair == NULL) {
+        return false;
+    }
+    *first = pair->first;
+    *second = pair->second;
+    return true;
+}
+
+bool polyseed_is_nfkd_stable(int32_t cp) {
+    int32_t first, second;
+    if (cp < 0x80) {
+        return true;
+    }
+    if (unicode_is_combining(cp)) {
+        /* U+0340, U+0341, U+0343 and U+0344 have singleton decompositions */
+        return cp < 0x0340 || cp > 0x0344 || cp == 0x0342;
+    }
+    if (cp >= 0x1100 && cp <= 0x11ff) { /* Hangul Jamo */
+        return true;
+    }
+    if ((cp >= 0x3041 && cp <= 0x3096) || (cp >= 0x30a1 && cp <= 0x30fa) ||
+        cp == 0x30fc) { /* Hiragana, Katakana */
+        return !polyseed_decompose(cp, &first, &second);
+    }
+    if ((cp >= 0x3400 && cp <= 0x4dbf) || (cp >= 0x4e00 && cp <= 0x9fff)) {
+        return true; /* CJK ideographs */
+    }
+    return false;
+}
+
+static bool put_char(polyseed_str norm, size_t* size, int32_t cp) {
+    char buff[4];
+    size_t n = polyseed_utf8_put(buff, cp);
+    if (*size + n > POLYSEED_STR_SIZE - 1) {
+        return false;
+    }
+    memcpy(&norm[*size], buff, n);
+    *size += n;
+    return true;
+}
+
+bool polyseed_utf8_nfkd(const char* str, size_t len, polyseed_str norm,
+    size_t* size_out) {
+    const char* end = str + len;
+    size_t size = 0;
+    bool prev_mark = false;
+    while (str < end) {
+        int32_t out[3];
+        int n = 1;
+        int32_t cp = polyseed_utf8_next(&str, end);
+        if (cp < 0) {
+            return false;
+        }
+        out[0] = cp;
+        if (unicode_is_space(cp)) {
+            out[0] = ' ';
+        }
+        else if (cp >= 0xff01 && cp <= 0xff5e) { /* full-width ASCII */
+            out[0] = cp - 0xfee0;
+        }
+        else if (cp >= HANGUL_S_BASE && cp < HANGUL_S_BASE + HANGUL_S_COUNT) {
+            /* Hangul syllable to Jamo */
+            int32_t s_index = cp - HANGUL_S_BASE;
+            int32_t t_index = s_index % HANGUL_T_COUNT;
+            out[0] = HANGUL_L_BASE + s_index / HANGUL_N_COUNT;
+            out[1] = HANGUL_V_BASE + (s_index % HANGUL_N_COUNT) / HANGUL_T_COUNT;
+            out[2] = HANGUL_T_BASE + t_index;
+            n = t_index != 0 ? 3 : 2;
+        }
+        else if (polyseed_decompose(cp, &out[0], &out[1])) {
+            n = 2;
+        }
+        else if (!polyseed_is_nfkd_stable(cp)) {
+            return false;
+        }
+        for (int i = 0; i < n; ++i) {
+            bool mark = unicode_is_combining(out[i]);
+            if (mark && prev_mark) {
+                return false; /* canonical ordering is not supported */
+            }
+            prev_mark = mark;
+            if (!put_char(norm, &size, out[i])) {
+                goto truncate;
+            }
+        }
+    }
+truncate:
+    norm[size] = '\0';
+    *size_out = size;
+    return true;
+}
@@ -0,0 +1,96 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef UNICODE_H
+#define UNICODE_H
+
+#include "polyseed.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hangul syllables are composed algorithmically from Jamo */
+#define HANGUL_S_BASE 0xac00
+#define HANGUL_L_BASE 0x1100
+#define HANGUL_V_BASE 0x1161
+#define HANGUL_T_BASE 0x11a7
+#define HANGUL_L_COUNT 19
+#define HANGUL_V_COUNT 21
+#define HANGUL_T_COUNT 28
+#define HANGUL_N_COUNT (HANGUL_V_COUNT * HANGUL_T_COUNT)
+#define HANGUL_S_COUNT (HANGUL_L_COUNT * HANGUL_N_COUNT)
+
+/* Result of polyseed_utf8_check */
+typedef enum utf8_class {
+    UTF8_INVALID,
+    UTF8_ASCII,
+    UTF8_MULTIBYTE,
+} utf8_class;
+
+static inline bool unicode_is_combining(int32_t cp) {
+    return (cp >= 0x0300 && cp <= 0x036f) || cp == 0x3099 || cp == 0x309a;
+}
+
+/* characters with a compatibility decomposition to U+0020 */
+static inline bool unicode_is_space(int32_t cp) {
+    return cp == 0x20 || cp == 0xa0 || (cp >= 0x2000 && cp <= 0x200a) ||
+        cp == 0x202f || cp == 0x205f || cp == 0x3000;
+}
+
+/*
+ * Decodes one UTF-8 character and advances *str past it. No bytes at or
+ * after end are read. Returns -1 for invalid sequences and sequences
+ * that are cut short by end (*str is not advanced).
+ */
+POLYSEED_PRIVATE int32_t polyseed_utf8_next(const char** str,
+    const char* end);
+
+/*
+ * Validates a UTF-8 string of length len (excluding the terminating null)
+ * and classifies it as pure ASCII or containing multibyte characters.
+ * Runs of ASCII characters are skipped using SIMD instructions if available.
+ */
+POLYSEED_PRIVATE utf8_class polyseed_utf8_check(const char* str, size_t len);
+
+/*
+ * Encodes a character as UTF-8. The output buffer must have space for
+ * at least 4 bytes. Returns the number of bytes written.
+ */
+POLYSEED_PRIVATE size_t polyseed_utf8_put(char* out, int32_t cp);
+
+/*
+ * Returns the canonical composition of two characters or -1 if they
+ * don't compose. Supports Hangul Jamo and the precomposed characters
+ * used by the wordlists (lowercase Latin letters with common diacritics
+ * and kana with voicing marks).
+ */
+POLYSEED_PRIVATE int32_t polyseed_compose(int32_t first, int32_t second);
+
+/*
+ * Canonical decomposition of a precomposed character into two characters.
+ * Supports the same repertoire as polyseed_compose.
+ * Returns false if the character doesn't decompose.
+ */
+POLYSEED_PRIVATE bool polyseed_decompose(int32_t cp, int32_t* first,
+    int32_t* second);
+
+/*
+ * Returns true if the character is known to be unchanged by NFKD:
+ * ASCII, combining diacritics and voicing marks, Hangul Jamo, kana
+ * without a voicing mark and CJK ideographs.
+ */
+POLYSEED_PRIVATE bool polyseed_is_nfkd_stable(int32_t cp);
+
+/*
+ * Converts a UTF-8 string of len bytes to NFKD. The string must have been
+ * validated with polyseed_utf8_check. Only supports the characters that are
+ * NFKD-stable or decompose with polyseed_decompose, Hangul syllables,
+ * spaces and full-width ASCII. Returns false if the string contains other
+ * characters or a sequence of combining marks that might need reordering.
+ * The output is truncated to POLYSEED_STR_SIZE - 1 bytes.
+ */
+POLYSEED_PRIVATE bool polyseed_utf8_nfkd(const char* str, size_t len,
+    polyseed_str norm, size_t* size_out);
+
+#endif
@@ -0,0 +1,287 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <polyseed.h>
+#include <src/lang.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define LOOKUP_ROUNDS 1000
+#define DECODE_ROUNDS 20000
+
+static volatile int g_sink;
+
+static double get_time(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void randbytes_rand(void* result, size_t n) {
+    uint8_t* out = result;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = rand() & 0xff;
+    }
+}
+
+static void pbkdf2_dummy(const uint8_t* pw, size_t pwlen,
+    const uint8_t* salt, size_t saltlen, uint64_t iterations,
+    uint8_t* key, size_t keylen) {
+    (void)pw;
+    (void)pwlen;
+    (void)salt;
+    (void)saltlen;
+    (void)iterations;
+    memset(key, 0, keylen);
+}
+
+static size_t u8_nfkd_spaces(const char* str, polyseed_str norm) {
+    /* normalize only ideographic spaces to allow Japanese phrases to roundtrip */
+    int i = 0;
+    for (; i < POLYSEED_STR_SIZE - 1 && *str != '\0'; ++i) {
+        if (str[0] == '\xe3' && str[1] == '\x80' && str[2] == '\x80') {
+            norm[i] = ' ';
+            str += 3;
+        }
+        else {
+            norm[i] = *str;
+            ++str;
+        }
+    }
+    norm[i] = '\0';
+    return i;
+}
+
+static void memzero_dummy(void* const ptr, const size_t len) {
+    memset(ptr, 0, len);
+}
+
+/* average time of polyseed_lang_find_word over the whole wordlist */
+static void bench_lookup(const polyseed_lang* lang, bool prefix) {
+    static char keys[POLYSEED_LANG_SIZE][64];
+    for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+        strncpy(keys[i], lang_word(lang, i), sizeof(keys[i]) - 1);
+        if (prefix && strlen(keys[i]) > 4) {
+            keys[i][4] = '\0';
+        }
+    }
+    int found = 0;
+    double start = get_time();
+    for (int r = 0; r < LOOKUP_ROUNDS; ++r) {
+        for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+            found += polyseed_lang_find_word(lang, keys[i]) >= 0;
+        }
+    }
+    double elapsed = get_time() - start;
+    g_sink = found;
+    printf("%-22s %-7s %8.1f ns/word\n", lang->name_en,
+        prefix ? "prefix" : "full",
+        elapsed * 1e9 / (LOOKUP_ROUNDS * POLYSEED_LANG_SIZE));
+}
+
+/* Converts an encoded phrase to the decomposed form expected by the decoder.
+   The dummy u8_nfkd function doesn't decompose precomposed characters. */
+static void decompose_phrase(const polyseed_lang* lang, polyseed_str phrase) {
+    polyseed_str out;
+    char* pos = out;
+    const char* word = phrase;
+    size_t sep_len = strlen(lang->separator);
+    for (int w = 0; w < POLYSEED_NUM_WORDS; ++w) {
+        const char* end = strstr(word, lang->separator);
+        size_t len = end != NULL ? (size_t)(end - word) : strlen(word);
+        for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+            if (lang_word_nfc_length(lang, i) == len &&
+                0 == memcmp(lang_word_nfc(lang, i), word, len)) {
+                strcpy(pos, lang_word(lang, i));
+                pos += lang_word_length(lang, i);
+                break;
+            }
+        }
+        if (end == NULL) {
+            break;
+        }
+        strcpy(pos, lang->separator);
+        pos += sep_len;
+        word = end + sep_len;
+    }
+    strcpy(phrase, out);
+}
+
+/* average time of polyseed_decode for phrases in one language */
+static void bench_decode(const polyseed_lang* lang) {
+    polyseed_data* seed;
+    polyseed_str phrase;
+    polyseed_status res = polyseed_create(0, &seed);
+    if (res != POLYSEED_OK) {
+        return;
+    }
+    polyseed_encode(seed, lang, POLYSEED_MONERO, phrase);
+    polyseed_free(seed);
+    decompose_phrase(lang, phrase);
+    int ok = 0;
+    double start = get_time();
+    for (int r = 0; r < DECODE_ROUNDS; ++r) {
+        res = polyseed_decode(phrase, POLYSEED_MONERO, NULL, &seed);
+        if (res == POLYSEED_OK) {
+            polyseed_free(seed);
+            ok++;
+        }
+    }
+    double elapsed = get_time() - start;
+    g_sink = ok;
+    printf("%-22s %-7s %8.1f ns/phrase\n", lang->name_en, "decode",
+        elapsed * 1e9 / DECODE_ROUNDS);
+}
+
+#define BATCH_SIZE 100
+
+/* average time per phrase of polyseed_decode_batch compared to decoding
+   the phrases one by one */
+static void bench_decode_batch(const polyseed_lang* lang) {
+    static char buffer[BATCH_SIZE * POLYSEED_STR_SIZE];
+    size_t offsets[BATCH_SIZE + 1];
+    polyseed_status status[BATCH_SIZE];
+    polyseed_storage storage[BATCH_SIZE];
+    offsets[0] = 0;
+    for (int i = 0; i < BATCH_SIZE; ++i) {
+        polyseed_data* seed;
+        polyseed_str phrase;
+        if (polyseed_create(0, &seed) != POLYSEED_OK) {
+            return;
+        }
+        polyseed_encode(seed, lang, POLYSEED_MONERO, phrase);
+        polyseed_free(seed);
+        decompose_phrase(lang, phrase);
+        size_t length = strlen(phrase);
+        memcpy(&buffer[offsets[i]], phrase, length);
+        offsets[i + 1] = offsets[i] + length;
+    }
+    /* the same phrases decoded one by one */
+    size_t ok = 0;
+    double start = get_time();
+    for (int r = 0; r < DECODE_ROUNDS / BATCH_SIZE; ++r) {
+        for (int i = 0; i < BATCH_SIZE; ++i) {
+            polyseed_data* seed;
+            if (polyseed_decode_n(&buffer[offsets[i]],
+                offsets[i + 1] - offsets[i], POLYSEED_MONERO, NULL,
+                &seed) == POLYSEED_OK) {
+                polyseed_store(seed, storage[i]);
+                polyseed_free(seed);
+                ok++;
+            }
+        }
+    }
+    double elapsed = get_time() - start;
+    printf("%-22s %-7s %8.1f ns/phrase\n", lang->name_en, "single",
+        elapsed * 1e9 / DECODE_ROUNDS);
+    start = get_time();
+    for (int r = 0; r < DECODE_ROUNDS / BATCH_SIZE; ++r) {
+        ok += polyseed_decode_batch(buffer, offsets, BATCH_SIZE,
+            POLYSEED_MONERO, status, NULL, storage);
+    }
+    elapsed = get_time() - start;
+    g_sink = (int)ok;
+    printf("%-22s %-7s %8.1f ns/phrase\n", lang->name_en, "batch",
+        elapsed * 1e9 / DECODE_ROUNDS);
+}
+
+/* average time of polyseed_phrase_split and polyseed_phrase_decode
+   (tokenization, language detection and lookup of a normalized phrase) */
+static void bench_phrase(const polyseed_lang* lang, bool invalid) {
+    polyseed_str str;
+    char* pos = str;
+    for (int i = 0; i < POLYSEED_NUM_WORDS; ++i) {
+        const char* word = lang_word(lang, rand() % POLYSEED_LANG_SIZE);
+        if (invalid && i == POLYSEED_NUM_WORDS - 1) {
+            word = "xxx";
+        }
+        if (i > 0) {
+            *pos++ = ' ';
+        }
+        strcpy(pos, word);
+        pos += strlen(word);
+    }
+    size_t length = pos - str;
+    polyseed_phrase phrase;
+    uint_fast16_t idx[POLYSEED_NUM_WORDS];
+    int ok = 0;
+    double start = get_time();
+    for (int r = 0; r < DECODE_ROUNDS; ++r) {
+        polyseed_phrase_split(str, length, phrase);
+        ok += polyseed_phrase_decode(phrase, idx, NULL) == POLYSEED_OK;
+    }
+    double elapsed = get_time() - start;
+    g_sink = ok;
+    printf("%-22s %-7s %8.1f ns/phrase\n", lang->name_en,
+        invalid ? "invalid" : "phrase", elapsed * 1e9 / DECODE_ROUNDS);
+}
+
+/* average time of polyseed_decode for a phrase with an invalid last word */
+static void bench_decode_invalid(const polyseed_lang* lang) {
+    polyseed_data* seed;
+    polyseed_str phrase;
+    polyseed_status res = polyseed_create(0, &seed);
+    if (res != POLYSEED_OK) {
+        return;
+    }
+    polyseed_encode(seed, lang, POLYSEED_MONERO, phrase);
+    polyseed_free(seed);
+    decompose_phrase(lang, phrase);
+    /* replace the last word */
+    char* last = phrase;
+    char* sep;
+    while ((sep = strstr(last, lang->separator)) != NULL) {
+        last = sep + strlen(lang->separator);
+    }
+    strcpy(last, "xxx");
+    int err = 0;
+    double start = get_time();
+    for (int r = 0; r < DECODE_ROUNDS; ++r) {
+        res = polyseed_decode(phrase, POLYSEED_MONERO, NULL, &seed);
+        err += res == POLYSEED_ERR_LANG;
+    }
+    double elapsed = get_time() - start;
+    g_sink = err;
+    printf("%-22s %-7s %8.1f ns/phrase\n", lang->name_en, "invalid",
+        elapsed * 1e9 / DECODE_ROUNDS);
+}
+
+int main() {
+    const polyseed_dependency deps = {
+        .randbytes = &randbytes_rand,
+        .pbkdf2_sha256 = &pbkdf2_dummy,
+        .memzero = &memzero_dummy,
+        .u8_nfkd = &u8_nfkd_spaces,
+    };
+    polyseed_inject(&deps);
+
+    int num_langs = polyseed_get_num_langs();
+    for (int i = 0; i < num_langs; ++i) {
+        const polyseed_lang* lang = polyseed_get_lang(i);
+        bench_lookup(lang, false);
+        if (lang->has_prefix) {
+            bench_lookup(lang, true);
+        }
+    }
+    for (int i = 0; i < num_langs; ++i) {
+        bench_phrase(polyseed_get_lang(i), false);
+    }
+    for (int i = 0; i < num_langs; ++i) {
+        bench_phrase(polyseed_get_lang(i), true);
+    }
+    for (int i = 0; i < num_langs; ++i) {
+        bench_decode(polyseed_get_lang(i));
+    }
+    for (int i = 0; i < num_langs; ++i) {
+        bench_decode_batch(polyseed_get_lang(i));
+    }
+    for (int i = 0; i < num_langs; ++i) {
+        bench_decode_invalid(polyseed_get_lang(i));
+    }
+    return 0;
+}
@@ -8,12 +8,21 @@
 #include <polyseed.h>
 
 #include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <limits.h>
 #include <stdlib.h>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 typedef bool test_func(void);
 typedef void multitest_func(void);
@@ -30,6 +39,7 @@ static int g_test_no = 0;
 
 static int g_num_langs;
 static int g_num_allocs;
+static int g_num_nfkd_calls;
 
 static polyseed_data* g_seed1;
 static polyseed_data* g_seed2;
@@ -54,10 +64,16 @@ static const char* g_phrase_en4 =
 static const char* g_phrase_en5 =
     "raven tail swear infant grief assist regular lamp "
     "duck valid someone little harsh puppy airport language ";
+static const char* g_phrase_en6 =
+    "  raven\ttail  swear\tinfant grief \t assist regular lamp\n"
+    "duck valid someone\r\nlittle harsh puppy airport language\n";
+static const char* g_phrase_en7 =
+    u8"raven\u3000tail swear infant grief assist regular lamp "
+    u8"duck valid someone little harsh puppy airport\u3000\u3000language";
 
 static const char* g_phrase_es1 =
-    u8"eje fin parte célebre tabú pestaña lienzo puma "
-    u8"prisión hora regalo lengua existir lápiz lote sonoro";
+    u8"eje fin parte célebre tabú pestaña lienzo puma "
+    u8"prisión hora regalo lengua existir lápiz lote sonoro";
 static const char* g_phrase_es2 =
     "eje fin parte celebre tabu pestana lienzo puma "
     "prision hora regalo lengua existir lapiz lote sonoro";
@@ -75,6 +91,21 @@ static const char* g_phrase_es_mult =
     "impo sort usua cabi venu nobl oliv clim "
     "cont barr marc auto prod vaca torn fati";
 
+static const char* g_phrase_zh_garbage =
+    u8"的 一 是 在 不 了 有 和 人 这 中 大 为 上 个 鑫";
+
+static const char* g_phrase_mixed_script =
+    u8"raven tail swear infant grief assist regular lamp "
+    u8"duck valid someone little harsh puppy airport あいこくしん";
+
+static const char* g_phrase_nfkd_fallback =
+    u8"raven tail swear infant grief assist regular lamp "
+    u8"duck valid someone little harsh puppy airport Ångström";
+
+static const char* g_phrase_invalid_utf8 =
+    "raven tail swear infant grief assist regular lamp "
+    "duck valid someone little harsh puppy airport \xe8\xa8";
+
 static const char* g_phrase_garbage1 = "xxx xxx";
 
 static const char* g_phrase_garbage2 =
@@ -234,23 +265,70 @@ static void pbkdf2_dummy3(const uint8_t* pw, size_t pwlen,
     }
 }
 
-static size_t u8_nfc_donothing(const char* str, polyseed_str norm) {
-    /* do not compose */
-    strncpy(norm, str, POLYSEED_STR_SIZE);
-    return POLYSEED_STR_SIZE - 1;
-}
+/* precomposed characters that occur in the wordlists */
+static const char* g_decompositions[][2] = {
+    { u8"á", u8"a\u0301" }, { u8"é", u8"e\u0301" }, { u8"í", u8"i\u0301" },
+    { u8"ñ", u8"n\u0303" }, { u8"ó", u8"o\u0301" }, { u8"ú", u8"u\u0301" },
+    { u8"è", u8"e\u0300" }, { u8"が", u8"か\u3099" }, { u8"ぎ", u8"き\u3099" },
+    { u8"ぐ", u8"く\u3099" }, { u8"げ", u8"け\u3099" }, { u8"ご", u8"こ\u3099" },
+    { u8"ざ", u8"さ\u3099" }, { u8"じ", u8"し\u3099" }, { u8"ず", u8"す\u3099" },
+    { u8"ぜ", u8"せ\u3099" }, { u8"ぞ", u8"そ\u3099" }, { u8"だ", u8"た\u3099" },
+    { u8"づ", u8"つ\u3099" }, { u8"で", u8"て\u3099" }, { u8"ど", u8"と\u3099" },
+    { u8"ば", u8"は\u3099" }, { u8"ぱ", u8"は\u309a" }, { u8"び", u8"ひ\u3099" },
+    { u8"ぴ", u8"ひ\u309a" }, { u8"ぶ", u8"ふ\u3099" }, { u8"ぷ", u8"ふ\u309a" },
+    { u8"べ", u8"へ\u3099" }, { u8"ぺ", u8"へ\u309a" }, { u8"ぼ", u8"ほ\u3099" },
+    { u8"ぽ", u8"ほ\u309a" },
+};
 
-static size_t u8_nfkd_spaces(const char* str, polyseed_str norm) {
-    /* normalize only ideographic spaces to allow Japanese phrases to roundtrip */
+static size_t u8_nfkd_basic(const char* str, polyseed_str norm) {
+    /* Decompose the characters that can be produced by polyseed_encode
+       and normalize ideographic spaces to allow phrases to roundtrip. */
     int i = 0;
-    for (; i < POLYSEED_STR_SIZE - 1 && *str != '\0'; ++i) {
-        if (str[0] == '\xe3' && str[1] == '\x80' && str[2] == '\x80') {
-            norm[i] = ' ';
+    g_num_nfkd_calls++;
+    while (i < POLYSEED_STR_SIZE - 1 && *str != '\0') {
+        const uint8_t* s = (const uint8_t*)str;
+        if (s[0] == 0xe3 && s[1] == 0x80 && s[2] == 0x80) {
+            norm[i++] = ' ';
             str += 3;
+            continue;
+        }
+        if (s[0] >= 0xea && s[0] <= 0xed && (s[1] & 0xc0) == 0x80) {
+            unsigned cp = ((s[0] & 0x0f) << 12) | ((s[1] & 0x3f) << 6) | (s[2] & 0x3f);
+            if (cp >= 0xac00 && cp <= 0xd7a3) {
+                /* Hangul syllable */
+                unsigned jamo[3] = {
+                    0x1100 + (cp - 0xac00) / 588,
+                    0x1161 + (cp - 0xac00) % 588 / 28,
+                    0x11a7 + (cp - 0xac00) % 28,
+                };
+                for (int j = 0; j < 3 && i < POLYSEED_STR_SIZE - 3; ++j) {
+                    if (j == 2 && jamo[j] == 0x11a7) {
+                        break;
+                    }
+                    norm[i++] = 0xe0 | (jamo[j] >> 12);
+                    norm[i++] = 0x80 | ((jamo[j] >> 6) & 0x3f);
+                    norm[i++] = 0x80 | (jamo[j] & 0x3f);
+                }
+                str += 3;
+                continue;
+            }
         }
-        else {
-            norm[i] = *str;
-            ++str;
+        bool found = false;
+        for (size_t j = 0; j < sizeof(g_decompositions) / sizeof(g_decompositions[0]); ++j) {
+            const char* comp = g_decompositions[j][0];
+            size_t comp_len = strlen(comp);
+            if (0 == strncmp(str, comp, comp_len)) {
+                const char* decomp = g_decompositions[j][1];
+                for (; *decomp != '\0' && i < POLYSEED_STR_SIZE - 1; ++decomp) {
+                    norm[i++] = *decomp;
+                }
+                str += comp_len;
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            norm[i++] = *str++;
         }
     }
     norm[i] = '\0';
@@ -305,8 +383,7 @@ static bool test_inject1(void) {
     const polyseed_dependency deps = {
         .randbytes = &gen_rand_bytes1,
         .pbkdf2_sha256 = &pbkdf2_dummy1,
-        .u8_nfc = &u8_nfc_donothing,
-        .u8_nfkd = &u8_nfkd_spaces,
+        .u8_nfkd = &u8_nfkd_basic,
         .time = &time1,
         .memzero = &do_not_zero,
         .alloc = &count_alloc,
@@ -485,6 +562,25 @@ static bool test_decode_en_space(void) {
     return true;
 }
 
+static bool test_decode_en_whitespace(void) {
+    if (g_lang_en == NULL) {
+        return false;
+    }
+    const polyseed_lang* lang;
+    polyseed_data* seed;
+    polyseed_status res = polyseed_decode(g_phrase_en6, POLYSEED_MONERO, &lang, &seed);
+    assert(res == POLYSEED_OK);
+    assert(lang == g_lang_en);
+    check_key(seed, POLYSEED_MONERO);
+    polyseed_free(seed);
+    res = polyseed_decode(g_phrase_en7, POLYSEED_MONERO, &lang, &seed);
+    assert(res == POLYSEED_OK);
+    assert(lang == g_lang_en);
+    check_key(seed, POLYSEED_MONERO);
+    polyseed_free(seed);
+    return true;
+}
+
 static bool test_decode_en_coin(void) {
     if (g_lang_en == NULL) {
         return false;
@@ -514,6 +610,25 @@ static void test_roundtrip1(void) {
     }
 }
 
+static bool test_roundtrip_ko_builtin_nfkd(void) {
+    const polyseed_lang* lang = get_lang("Korean");
+    if (lang == NULL) {
+        return false;
+    }
+    /* Hangul syllables are decomposed without calling u8_nfkd */
+    int num_calls = g_num_nfkd_calls;
+    const polyseed_lang* lang_out;
+    polyseed_str phrase;
+    polyseed_data* seed;
+    polyseed_encode(g_seed1, lang, POLYSEED_MONERO, phrase);
+    polyseed_status res = polyseed_decode(phrase, POLYSEED_MONERO, &lang_out, &seed);
+    assert(res == POLYSEED_OK);
+    assert(lang == lang_out);
+    assert(g_num_nfkd_calls == num_calls);
+    polyseed_free(seed);
+    return true;
+}
+
 static bool test_free1(void) {
     polyseed_free(g_seed1);
     return true;
@@ -528,8 +643,7 @@ static bool test_inject2(void) {
     const polyseed_dependency deps = {
         .randbytes = &gen_rand_bytes2,
         .pbkdf2_sha256 = &pbkdf2_dummy2,
-        .u8_nfc = &u8_nfc_donothing,
-        .u8_nfkd = &u8_nfkd_spaces,
+        .u8_nfkd = &u8_nfkd_basic,
         .time = &time2,
         .memzero = &do_not_zero,
         .alloc = &count_alloc,
@@ -602,6 +716,20 @@ static bool test_encode_es(void) {
     return true;
 }
 
+static bool test_decode_es_builtin_nfkd(void) {
+    if (g_lang_es == NULL) {
+        return false;
+    }
+    /* the composed phrase is normalized without calling u8_nfkd */
+    int num_calls = g_num_nfkd_calls;
+    polyseed_data* seed;
+    polyseed_status res = polyseed_decode(g_phrase_es1, POLYSEED_MONERO, NULL, &seed);
+    assert(res == POLYSEED_OK);
+    assert(g_num_nfkd_calls == num_calls);
+    polyseed_free(seed);
+    return true;
+}
+
 static bool test_decode_es(void) {
     if (g_lang_es == NULL) {
         return false;
@@ -694,8 +822,7 @@ static bool test_inject3(void) {
     const polyseed_dependency dep = {
         .randbytes = &gen_rand_bytes3,
         .pbkdf2_sha256 = &pbkdf2_dummy3,
-        .u8_nfc = &u8_nfc_donothing,
-        .u8_nfkd = &u8_nfkd_spaces,
+        .u8_nfkd = &u8_nfkd_basic,
         .time = &time3,
         .memzero = &do_not_zero,
         .alloc = &count_alloc,
@@ -799,6 +926,26 @@ static bool test_decrypt(void) {
     return true;
 }
 
+static bool test_decrypt_n(void) {
+    if (g_lang_en == NULL) {
+        return false;
+    }
+    /* the phrase and the password are followed by unrelated characters */
+    polyseed_str buffer;
+    size_t length = strlen(g_phrase_out);
+    memcpy(buffer, g_phrase_out, length);
+    memcpy(&buffer[length], " raven", 6);
+    polyseed_data* seed;
+    polyseed_status res = polyseed_decode_n(buffer, length, POLYSEED_AEON, NULL, &seed);
+    assert(res == POLYSEED_OK);
+    assert(polyseed_is_encrypted(seed));
+    polyseed_crypt_n(seed, "password1", 8);
+    assert(!polyseed_is_encrypted(seed));
+    check_key(seed, POLYSEED_AEON);
+    polyseed_free(seed);
+    return true;
+}
+
 static bool test_free3(void) {
     polyseed_free(g_seed3);
     return true;
@@ -820,6 +967,65 @@ static bool test_decode_garbage2(void) {
     return true;
 }
 
+static bool test_decode_zh_garbage(void) {
+    const polyseed_lang* lang;
+    polyseed_data* seed;
+    polyseed_status res = polyseed_decode(g_phrase_zh_garbage, POLYSEED_MONERO, &lang, &seed);
+    assert(res == POLYSEED_ERR_LANG);
+    return true;
+}
+
+static bool test_decode_mixed_script(void) {
+    const polyseed_lang* lang;
+    polyseed_data* seed;
+    polyseed_status res = polyseed_decode(g_phrase_mixed_script, POLYSEED_MONERO, &lang, &seed);
+    assert(res == POLYSEED_ERR_LANG);
+    return true;
+}
+
+static bool test_decode_nfkd_fallback(void) {
+    /* unsupported characters are normalized by u8_nfkd */
+    int num_calls = g_num_nfkd_calls;
+    polyseed_data* seed;
+    polyseed_status res = polyseed_decode(g_phrase_nfkd_fallback, POLYSEED_MONERO, NULL, &seed);
+    assert(res == POLYSEED_ERR_LANG);
+    assert(g_num_nfkd_calls == num_calls + 1);
+    return true;
+}
+
+static bool test_decode_invalid_utf8(void) {
+    polyseed_data* seed;
+    polyseed_status res = polyseed_decode(g_phrase_invalid_utf8, POLYSEED_MONERO, NULL, &seed);
+    assert(res == POLYSEED_ERR_UTF8);
+    return true;
+}
+
+static bool test_decode_truncated_utf8(void) {
+    /* a multibyte character cut short by the end of a buffer that is not
+       null-terminated or by the length of the phrase */
+    static const char* const tails[] = {
+        "\xc3", "\xe8\xa8", "\xf0\x9f\x98",
+    };
+    size_t prefix = strlen(g_phrase_en1);
+    for (int i = 0; i < 4; ++i) {
+        const char* tail = i < 3 ? tails[i] : "\xc3\xa9";
+        size_t size = prefix + 1 + strlen(tail);
+        char* buffer = malloc(size);
+        assert(buffer != NULL);
+        memcpy(buffer, g_phrase_en1, prefix);
+        buffer[prefix] = ' ';
+        memcpy(&buffer[prefix + 1], tail, size - prefix - 1);
+        /* the last sequence crosses the length */
+        size_t length = i < 3 ? size : size - 1;
+        polyseed_data* seed;
+        polyseed_status res = polyseed_decode_n(buffer, length,
+            POLYSEED_MONERO, NULL, &seed);
+        assert(res == POLYSEED_ERR_UTF8);
+        free(buffer);
+    }
+    return true;
+}
+
 static bool test_memleak(void) {
     assert(g_num_allocs == 0);
     return true;
@@ -829,8 +1035,7 @@ static bool test_inject4(void) {
     const polyseed_dependency dep = {
         .randbytes = &gen_rand_bytes3,
         .pbkdf2_sha256 = &pbkdf2_dummy3,
-        .u8_nfc = &u8_nfc_donothing,
-        .u8_nfkd = &u8_nfkd_spaces,
+        .u8_nfkd = &u8_nfkd_basic,
         .memzero = &do_not_zero,
         .alloc = &alloc_fail,
     };
@@ -852,6 +1057,809 @@ static bool test_out_of_memory2(void) {
     return true;
 }
 
+static bool test_out_of_memory_into(void) {
+    /* caller-provided memory doesn't need allocations */
+    polyseed_data* seed = malloc(polyseed_data_size());
+    assert(seed != NULL);
+    assert((uintptr_t)seed % polyseed_data_align() == 0);
+    polyseed_status res = polyseed_create_into(0, seed);
+    assert(res == POLYSEED_OK);
+    polyseed_storage storage1, storage2;
+    res = polyseed_decode_into(g_phrase_en1, POLYSEED_MONERO, NULL, seed);
+    assert(res == POLYSEED_OK);
+    polyseed_store(seed, storage1);
+    res = polyseed_decode_storage(g_phrase_en1, POLYSEED_MONERO, NULL, storage2);
+    assert(res == POLYSEED_OK);
+    assert(0 == memcmp(storage1, storage2, POLYSEED_SIZE));
+    res = polyseed_load_into(g_store3, seed);
+    assert(res == POLYSEED_OK);
+    res = polyseed_decode_into(g_phrase_en3, POLYSEED_MONERO, NULL, seed);
+    assert(res == POLYSEED_ERR_LANG);
+    polyseed_store(seed, storage1);
+    assert(0 == memcmp(storage1, g_store3, POLYSEED_SIZE)); /* not modified */
+    polyseed_erase(seed);
+    free(seed);
+    return true;
+}
+
+static bool test_decode_batch(void) {
+    /* phrases in one buffer without separators, decoded without allocations */
+    const char* phrases[] = {
+        g_phrase_en1, g_phrase_en3, g_phrase_es1, g_phrase_garbage1, g_phrase_en6,
+    };
+    const polyseed_status expected[] = {
+        POLYSEED_OK, POLYSEED_ERR_LANG, POLYSEED_OK, POLYSEED_ERR_NUM_WORDS,
+        POLYSEED_OK,
+    };
+    enum { COUNT = sizeof(phrases) / sizeof(phrases[0]) };
+    char buffer[COUNT * POLYSEED_STR_SIZE];
+    size_t offsets[COUNT + 1];
+    offsets[0] = 0;
+    for (int i = 0; i < COUNT; ++i) {
+        size_t length = strlen(phrases[i]);
+        memcpy(&buffer[offsets[i]], phrases[i], length);
+        offsets[i + 1] = offsets[i] + length;
+    }
+    polyseed_status status[COUNT];
+    const polyseed_lang* langs[COUNT];
+    polyseed_storage storage[COUNT];
+    size_t num_decoded = polyseed_decode_batch(buffer, offsets, COUNT,
+        POLYSEED_MONERO, status, langs, storage);
+    assert(num_decoded == 3);
+    for (int i = 0; i < COUNT; ++i) {
+        assert(status[i] == expected[i]);
+        if (status[i] != POLYSEED_OK) {
+            assert(langs[i] == NULL);
+            continue;
+        }
+        polyseed_storage single;
+        const polyseed_lang* lang;
+        polyseed_status res = polyseed_decode_storage(phrases[i],
+            POLYSEED_MONERO, &lang, single);
+        assert(res == POLYSEED_OK);
+        assert(langs[i] == lang);
+        assert(0 == memcmp(storage[i], single, POLYSEED_SIZE));
+    }
+    return true;
+}
+
+static bool test_decode_batch_split(void) {
+    /* the end offset of the last phrase splits a multibyte character */
+    static const char* const tail = " \xc3\xa9";
+    const char* phrases[] = { g_phrase_en1, g_phrase_en6, g_phrase_en1 };
+    enum { COUNT = sizeof(phrases) / sizeof(phrases[0]) };
+    size_t offsets[COUNT + 1];
+    offsets[0] = 0;
+    for (int i = 0; i < COUNT; ++i) {
+        offsets[i + 1] = offsets[i] + strlen(phrases[i]);
+    }
+    size_t size = offsets[COUNT] + strlen(tail);
+    char* buffer = malloc(size);
+    assert(buffer != NULL);
+    for (int i = 0; i < COUNT; ++i) {
+        memcpy(&buffer[offsets[i]], phrases[i], offsets[i + 1] - offsets[i]);
+    }
+    memcpy(&buffer[offsets[COUNT]], tail, strlen(tail));
+    offsets[COUNT] = size - 1;
+    polyseed_status status[COUNT];
+    polyseed_storage storage[COUNT];
+    size_t num_decoded = polyseed_decode_batch(buffer, offsets, COUNT,
+        POLYSEED_MONERO, status, NULL, storage);
+    assert(num_decoded == 2);
+    assert(status[0] == POLYSEED_OK);
+    assert(status[1] == POLYSEED_OK);
+    assert(status[2] == POLYSEED_ERR_UTF8);
+    free(buffer);
+    return true;
+}
+
+static bool test_encode_batch(void) {
+    if (g_lang_en == NULL) {
+        return false;
+    }
+    polyseed_storage storage[4];
+    memcpy(storage[0], g_store1, POLYSEED_SIZE);
+    memcpy(storage[1], g_store2, POLYSEED_SIZE);
+    memcpy(storage[2], g_store1, POLYSEED_SIZE);
+    storage[2][POLYSEED_SIZE - 1] ^= 1; /* invalid checksum */
+    memcpy(storage[3], g_store3, POLYSEED_SIZE);
+    enum { COUNT = sizeof(storage) / sizeof(storage[0]) };
+    char buffer[COUNT * (POLYSEED_STR_SIZE - 1)];
+    size_t offsets[COUNT + 1];
+    polyseed_status status[COUNT];
+    polyseed_data* seed = malloc(polyseed_data_size());
+    assert(seed != NULL);
+    size_t num_encoded = polyseed_encode_batch(storage, COUNT, g_lang_en,
+        POLYSEED_MONERO, buffer, sizeof(buffer), offsets, status);
+    assert(num_encoded == COUNT);
+    for (int i = 0; i < COUNT; ++i) {
+        size_t length = offsets[i + 1] - offsets[i];
+        polyseed_status res = polyseed_load_into(storage[i], seed);
+        assert(status[i] == res);
+        if (res != POLYSEED_OK) {
+            assert(length == 0);
+            continue;
+        }
+        polyseed_str phrase;
+        size_t expected = polyseed_encode(seed, g_lang_en, POLYSEED_MONERO,
+            phrase);
+        assert(length == expected);
+        assert(0 == memcmp(&buffer[offsets[i]], phrase, length));
+    }
+    /* the second phrase doesn't fit */
+    num_encoded = polyseed_encode_batch(storage, COUNT, g_lang_en,
+        POLYSEED_MONERO, buffer, offsets[2] - 1, offsets, status);
+    assert(num_encoded == 1);
+    assert(status[0] == POLYSEED_OK);
+    polyseed_erase(seed);
+    free(seed);
+    return true;
+}
+
+static bool test_inject5(void) {
+    const polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes3,
+        .pbkdf2_sha256 = &pbkdf2_dummy3,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+        .alloc = &polyseed_secure_alloc,
+        .free = &polyseed_secure_free,
+    };
+    polyseed_inject(&dep);
+    return true;
+}
+
+static bool test_secure_alloc(void) {
+    polyseed_data* seed1;
+    polyseed_data* seed2;
+    polyseed_status res = polyseed_create(0, &seed1);
+    assert(res == POLYSEED_OK);
+    res = polyseed_load(g_store3, &seed2);
+    assert(res == POLYSEED_OK);
+    assert(seed1 != seed2);
+    /* the allocator erases the memory even if memzero doesn't */
+    polyseed_free(seed2);
+    const uint8_t* mem = (const uint8_t*)seed2;
+    for (size_t i = 0; i < polyseed_data_size(); ++i) {
+        assert(mem[i] == 0);
+    }
+    res = polyseed_load(g_store3, &seed2);
+    assert(res == POLYSEED_OK);
+    polyseed_free(seed1);
+    polyseed_free(seed2);
+    /* seeds larger than a slot are not supported */
+    assert(polyseed_secure_alloc(1024) == NULL);
+    return true;
+}
+
+static bool test_context(void) {
+    /* the context has its own allocator and features */
+    const polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes3,
+        .pbkdf2_sha256 = &pbkdf2_dummy3,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+        .alloc = &count_alloc,
+        .free = &count_free,
+    };
+    polyseed_context* ctx;
+    polyseed_status res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    int num_enabled = polyseed_enable_features_ctx(ctx, 1);
+    assert(num_enabled == 1);
+    polyseed_enable_features(0);
+    polyseed_data* seed;
+    res = polyseed_create(1, &seed);
+    assert(res == POLYSEED_ERR_UNSUPPORTED);
+    res = polyseed_create_ctx(ctx, 1, &seed);
+    assert(res == POLYSEED_OK);
+    assert(g_num_allocs == 1);
+    polyseed_storage storage;
+    polyseed_store(seed, storage);
+    polyseed_free_ctx(ctx, seed);
+    assert(g_num_allocs == 0);
+    res = polyseed_load(storage, &seed);
+    assert(res == POLYSEED_ERR_UNSUPPORTED);
+    res = polyseed_load_ctx(ctx, storage, &seed);
+    assert(res == POLYSEED_OK);
+    assert(polyseed_get_feature(seed, 1) != 0);
+    polyseed_free_ctx(ctx, seed);
+    assert(g_num_allocs == 0);
+    polyseed_context_free(ctx);
+    /* a context in caller-provided memory with the secure allocator */
+    static max_align_t ctx_mem[32];
+    polyseed_dependency dep2 = dep;
+    dep2.alloc = &polyseed_secure_alloc;
+    dep2.free = &polyseed_secure_free;
+    assert(polyseed_context_size() <= sizeof(ctx_mem));
+    assert(_Alignof(max_align_t) % polyseed_context_align() == 0);
+    res = polyseed_context_init(ctx_mem, polyseed_context_size() - 1, &dep2,
+        &ctx);
+    assert(res == POLYSEED_ERR_MEMORY);
+    res = polyseed_context_init(ctx_mem, sizeof(ctx_mem), &dep2, &ctx);
+    assert(res == POLYSEED_OK);
+    assert((void*)ctx == (void*)ctx_mem);
+    res = polyseed_load_ctx(ctx, storage, &seed);
+    assert(res == POLYSEED_ERR_UNSUPPORTED);
+    num_enabled = polyseed_enable_features_ctx(ctx, 1);
+    assert(num_enabled == 1);
+    res = polyseed_load_ctx(ctx, storage, &seed);
+    assert(res == POLYSEED_OK);
+    assert(polyseed_get_feature(seed, 1) != 0);
+    polyseed_free_ctx(ctx, seed);
+    return true;
+}
+
+static int g_num_randbytes;
+
+static void gen_rand_bytes_batch(void* result, size_t n) {
+    /* rand_bytes1, rand_bytes2 and rand_bytes3 repeated */
+    static const char* const bytes[] = { rand_bytes1, rand_bytes2, rand_bytes3 };
+    uint8_t* out = result;
+    assert(n % sizeof(rand_bytes1) == 0);
+    for (size_t i = 0; i < n / sizeof(rand_bytes1); ++i) {
+        memcpy(&out[i * sizeof(rand_bytes1)], bytes[i % 3],
+            sizeof(rand_bytes1));
+    }
+    g_num_randbytes++;
+}
+
+static bool test_create_batch(void) {
+    polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes_batch,
+        .pbkdf2_sha256 = &pbkdf2_dummy3,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+        .time = &time1,
+    };
+    polyseed_context* ctx;
+    polyseed_status res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    polyseed_storage storage[100];
+    res = polyseed_create_batch_ctx(ctx, 0, 100, storage);
+    assert(res == POLYSEED_OK);
+    assert(g_num_randbytes == 2);
+    polyseed_context_free(ctx);
+    /* the seeds are the same as if they were created one by one */
+    polyseed_storage single;
+    dep.randbytes = &gen_rand_bytes1;
+    res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    polyseed_data* seed = malloc(polyseed_data_size());
+    assert(seed != NULL);
+    res = polyseed_create_into_ctx(ctx, 0, seed);
+    assert(res == POLYSEED_OK);
+    polyseed_store(seed, single);
+    polyseed_context_free(ctx);
+    /* the random bytes are requested for 64 seeds at a time */
+    for (int i = 0; i < 64; i += 3) {
+        assert(0 == memcmp(storage[i], single, POLYSEED_SIZE));
+    }
+    assert(0 == memcmp(storage[64], single, POLYSEED_SIZE));
+    assert(0 != memcmp(storage[1], single, POLYSEED_SIZE));
+    polyseed_erase(seed);
+    free(seed);
+    return true;
+}
+
+static uint8_t g_rand_counter;
+
+static void gen_rand_bytes_counter(void* result, size_t n) {
+    uint8_t* out = result;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = g_rand_counter++;
+    }
+    g_num_randbytes++;
+}
+
+static bool test_entropy_pool(void) {
+    const polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes_counter,
+        .pbkdf2_sha256 = &pbkdf2_dummy3,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+    };
+    polyseed_context* ctx;
+    polyseed_status res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    polyseed_enable_entropy_pool_ctx(ctx, 1);
+    polyseed_data* seed = malloc(polyseed_data_size());
+    assert(seed != NULL);
+    polyseed_storage storage[10];
+    g_num_randbytes = 0;
+    for (int i = 0; i < 10; ++i) {
+        res = polyseed_create_into_ctx(ctx, 0, seed);
+        assert(res == POLYSEED_OK);
+        polyseed_store(seed, storage[i]);
+        for (int j = 0; j < i; ++j) {
+            assert(0 != memcmp(storage[i], storage[j], POLYSEED_SIZE));
+        }
+    }
+    assert(g_num_randbytes == 1);
+#ifndef _WIN32
+    /* the child process must not use the bytes buffered by the parent */
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        res = polyseed_create_into_ctx(ctx, 0, seed);
+        _exit(res == POLYSEED_OK && g_num_randbytes == 2 ? 0 : 1);
+    }
+    int wstatus;
+    assert(waitpid(pid, &wstatus, 0) == pid);
+    assert(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+    res = polyseed_create_into_ctx(ctx, 0, seed);
+    assert(res == POLYSEED_OK);
+    assert(g_num_randbytes == 1);
+#endif
+#if defined(__linux__) && defined(SYS_fork)
+    /* a raw fork system call doesn't run the pthread_atfork handlers */
+    pid = (pid_t)syscall(SYS_fork);
+    assert(pid >= 0);
+    if (pid == 0) {
+        res = polyseed_create_into_ctx(ctx, 0, seed);
+        _exit(res == POLYSEED_OK && g_num_randbytes == 2 ? 0 : 1);
+    }
+    assert(waitpid(pid, &wstatus, 0) == pid);
+    assert(WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0);
+#endif
+    polyseed_erase(seed);
+    free(seed);
+    polyseed_context_free(ctx);
+    return true;
+}
+
+static void pbkdf2_mix(const uint8_t* pw, size_t pwlen,
+    const uint8_t* salt, size_t saltlen, uint64_t iterations,
+    uint8_t* key, size_t keylen) {
+    /* not a KDF, but the key depends on all inputs */
+    for (size_t i = 0; i < keylen; ++i) {
+        key[i] = (uint8_t)(iterations + i);
+        for (size_t j = 0; j < pwlen; ++j) {
+            key[i] = (uint8_t)(key[i] * 31 + pw[j]);
+        }
+        for (size_t j = 0; j < saltlen; ++j) {
+            key[i] = (uint8_t)(key[i] * 31 + salt[j]);
+        }
+    }
+}
+
+static int g_num_pbkdf2;
+
+static void pbkdf2_mix_count(const uint8_t* pw, size_t pwlen,
+    const uint8_t* salt, size_t saltlen, uint64_t iterations,
+    uint8_t* key, size_t keylen) {
+    pbkdf2_mix(pw, pwlen, salt, saltlen, iterations, key, keylen);
+    g_num_pbkdf2++;
+}
+
+static int g_num_pbkdf2_multi;
+
+static void pbkdf2_mix_multi(size_t count, const uint8_t* const* pw,
+    size_t pwlen, const uint8_t* const* salt, size_t saltlen,
+    uint64_t iterations, uint8_t* const* key, size_t keylen) {
+    assert(count > 0 && count <= 16);
+    for (size_t i = 0; i < count; ++i) {
+        pbkdf2_mix(pw[i], pwlen, salt[i], saltlen, iterations, key[i], keylen);
+    }
+    g_num_pbkdf2_multi++;
+}
+
+static bool test_keygen_batch(void) {
+    enum { COUNT = 20, KEY_SIZE = 32 };
+    polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes_counter,
+        .pbkdf2_sha256 = &pbkdf2_mix,
+        .pbkdf2_sha256_multi = &pbkdf2_mix_multi,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+    };
+    polyseed_context* ctx;
+    polyseed_status res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    polyseed_storage storage[COUNT];
+    res = polyseed_create_batch_ctx(ctx, 0, COUNT, storage);
+    assert(res == POLYSEED_OK);
+    uint8_t* mem = malloc(COUNT * polyseed_data_size());
+    assert(mem != NULL);
+    const polyseed_data* seeds[COUNT];
+    polyseed_coin coins[COUNT];
+    for (int i = 0; i < COUNT; ++i) {
+        polyseed_data* seed = (polyseed_data*)&mem[i * polyseed_data_size()];
+        res = polyseed_load_into_ctx(ctx, storage[i], seed);
+        assert(res == POLYSEED_OK);
+        seeds[i] = seed;
+        coins[i] = (i % 2) ? POLYSEED_AEON : POLYSEED_MONERO;
+    }
+    uint8_t keys[COUNT][KEY_SIZE];
+    g_num_pbkdf2_multi = 0;
+    polyseed_keygen_batch_ctx(ctx, seeds, coins, COUNT, KEY_SIZE, &keys[0][0]);
+    assert(g_num_pbkdf2_multi == 2);
+    polyseed_context_free(ctx);
+    /* the same keys without the multi-buffer function */
+    dep.pbkdf2_sha256_multi = NULL;
+    res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    uint8_t keys2[COUNT][KEY_SIZE];
+    polyseed_keygen_batch_ctx(ctx, seeds, coins, COUNT, KEY_SIZE,
+        &keys2[0][0]);
+    assert(0 == memcmp(keys, keys2, sizeof(keys)));
+    for (int i = 0; i < COUNT; ++i) {
+        uint8_t key[KEY_SIZE];
+        polyseed_keygen_ctx(ctx, seeds[i], coins[i], KEY_SIZE, key);
+        assert(0 == memcmp(keys[i], key, KEY_SIZE));
+    }
+    assert(0 != memcmp(keys[0], keys[1], KEY_SIZE));
+    assert(g_num_pbkdf2_multi == 2);
+    polyseed_context_free(ctx);
+    /* the batch uses and fills the key cache */
+    dep.pbkdf2_sha256 = &pbkdf2_mix_count;
+    dep.pbkdf2_sha256_multi = &pbkdf2_mix_multi;
+    res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    polyseed_enable_keygen_cache_ctx(ctx, 1);
+    polyseed_keygen_ctx(ctx, seeds[0], coins[0], KEY_SIZE, keys2[0]);
+    g_num_pbkdf2 = 0;
+    g_num_pbkdf2_multi = 0;
+    polyseed_keygen_batch_ctx(ctx, seeds, coins, 17, KEY_SIZE, &keys2[0][0]);
+    assert(g_num_pbkdf2_multi == 1);
+    assert(0 == memcmp(keys, keys2, 17 * KEY_SIZE));
+    polyseed_keygen_ctx(ctx, seeds[16], coins[16], KEY_SIZE, keys2[16]);
+    assert(g_num_pbkdf2 == 0);
+    for (int i = 0; i < COUNT; ++i) {
+        polyseed_erase_ctx(ctx, (polyseed_data*)seeds[i]);
+    }
+    free(mem);
+    polyseed_context_free(ctx);
+    return true;
+}
+
+static int g_num_hmac_init;
+
+static void hmac_init_copy(const uint8_t* key, size_t keylen, void* state) {
+    /* the state is the length and the key */
+    uint8_t* out = state;
+    assert(keylen < 255);
+    out[0] = (uint8_t)keylen;
+    memcpy(&out[1], key, keylen);
+    g_num_hmac_init++;
+}
+
+static void pbkdf2_mix_hmac(const void* state, const uint8_t* salt,
+    size_t saltlen, uint64_t iterations, uint8_t* key, size_t keylen) {
+    const uint8_t* pw = state;
+    pbkdf2_mix(&pw[1], pw[0], salt, saltlen, iterations, key, keylen);
+}
+
+static bool test_keygen_multi(void) {
+    enum { COUNT = 3, KEY_SIZE = 32 };
+    polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes_counter,
+        .pbkdf2_sha256 = &pbkdf2_mix_count,
+        .hmac_sha256_init = &hmac_init_copy,
+        .pbkdf2_sha256_hmac = &pbkdf2_mix_hmac,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+    };
+    polyseed_context* ctx;
+    polyseed_status res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    polyseed_data* seed = malloc(polyseed_data_size());
+    assert(seed != NULL);
+    res = polyseed_create_into_ctx(ctx, 0, seed);
+    assert(res == POLYSEED_OK);
+    const polyseed_coin coins[COUNT] = {
+        POLYSEED_MONERO, POLYSEED_AEON, POLYSEED_WOWNERO,
+    };
+    uint8_t keys[COUNT][KEY_SIZE];
+    g_num_hmac_init = 0;
+    polyseed_keygen_multi_ctx(ctx, seed, coins, COUNT, KEY_SIZE, &keys[0][0]);
+    assert(g_num_hmac_init == 1);
+    for (int i = 0; i < COUNT; ++i) {
+        uint8_t key[KEY_SIZE];
+        polyseed_keygen_ctx(ctx, seed, coins[i], KEY_SIZE, key);
+        assert(0 == memcmp(keys[i], key, KEY_SIZE));
+    }
+    assert(0 != memcmp(keys[0], keys[1], KEY_SIZE));
+    /* the keys are stored in the cache */
+    polyseed_enable_keygen_cache_ctx(ctx, 1);
+    polyseed_keygen_multi_ctx(ctx, seed, coins, COUNT, KEY_SIZE, &keys[0][0]);
+    g_num_pbkdf2 = 0;
+    for (int i = 0; i < COUNT; ++i) {
+        uint8_t key[KEY_SIZE];
+        polyseed_keygen_ctx(ctx, seed, coins[i], KEY_SIZE, key);
+        assert(0 == memcmp(keys[i], key, KEY_SIZE));
+    }
+    assert(g_num_pbkdf2 == 0);
+    polyseed_erase_ctx(ctx, seed);
+    free(seed);
+    polyseed_context_free(ctx);
+    return true;
+}
+
+static bool test_keygen_cache(void) {
+    enum { KEY_SIZE = 32 };
+    const polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes_counter,
+        .pbkdf2_sha256 = &pbkdf2_mix_count,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+    };
+    polyseed_context* ctx;
+    polyseed_status res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    polyseed_enable_keygen_cache_ctx(ctx, 1);
+    polyseed_data* seed = malloc(polyseed_data_size());
+    assert(seed != NULL);
+    res = polyseed_create_into_ctx(ctx, 0, seed);
+    assert(res == POLYSEED_OK);
+    polyseed_storage storage;
+    polyseed_store(seed, storage);
+    uint8_t key1[KEY_SIZE], key2[KEY_SIZE], key3[KEY_SIZE];
+    g_num_pbkdf2 = 0;
+    polyseed_keygen_ctx(ctx, seed, POLYSEED_MONERO, KEY_SIZE, key1);
+    polyseed_keygen_ctx(ctx, seed, POLYSEED_MONERO, KEY_SIZE, key2);
+    assert(g_num_pbkdf2 == 1);
+    assert(0 == memcmp(key1, key2, KEY_SIZE));
+    polyseed_keygen_ctx(ctx, seed, POLYSEED_AEON, KEY_SIZE, key3);
+    assert(g_num_pbkdf2 == 2);
+    assert(0 != memcmp(key1, key3, KEY_SIZE));
+    /* the cached keys are erased with the seed */
+    polyseed_erase_ctx(ctx, seed);
+    res = polyseed_load_into_ctx(ctx, storage, seed);
+    assert(res == POLYSEED_OK);
+    polyseed_keygen_ctx(ctx, seed, POLYSEED_MONERO, KEY_SIZE, key2);
+    assert(g_num_pbkdf2 == 3);
+    assert(0 == memcmp(key1, key2, KEY_SIZE));
+    polyseed_erase_ctx(ctx, seed);
+    free(seed);
+    polyseed_context_free(ctx);
+    return true;
+}
+
+static atomic_int g_num_callbacks;
+static atomic_int g_num_canceled;
+static atomic_bool g_kdf_blocked;
+static atomic_int g_num_async_allocs;
+
+static void* count_secure_alloc(size_t n) {
+    atomic_fetch_add(&g_num_async_allocs, 1);
+    return polyseed_secure_alloc(n);
+}
+
+static void count_callback(polyseed_job* job, polyseed_status status,
+    void* userdata) {
+    (void)job;
+    assert(userdata == &g_num_callbacks);
+    if (status == POLYSEED_ERR_CANCELED) {
+        atomic_fetch_add(&g_num_canceled, 1);
+    }
+    atomic_fetch_add(&g_num_callbacks, 1);
+}
+
+static void pbkdf2_mix_blocking(const uint8_t* pw, size_t pwlen,
+    const uint8_t* salt, size_t saltlen, uint64_t iterations,
+    uint8_t* key, size_t keylen) {
+    while (atomic_load(&g_kdf_blocked)) {
+    }
+    pbkdf2_mix(pw, pwlen, salt, saltlen, iterations, key, keylen);
+}
+
+static bool test_async(void) {
+    enum { COUNT = 100, KEY_SIZE = 32 };
+    polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes_counter,
+        .pbkdf2_sha256 = &pbkdf2_mix_blocking,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+        .alloc = &count_secure_alloc,
+        .free = &polyseed_secure_free,
+    };
+    polyseed_context* ctx;
+    polyseed_status res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    polyseed_data* seed = malloc(2 * polyseed_data_size());
+    assert(seed != NULL);
+    polyseed_data* seed2 = (polyseed_data*)((uint8_t*)seed +
+        polyseed_data_size());
+    res = polyseed_create_into_ctx(ctx, 0, seed);
+    assert(res == POLYSEED_OK);
+    polyseed_storage storage;
+    polyseed_store(seed, storage);
+    /* the workers are blocked, so at most one job per CPU starts */
+    atomic_store(&g_kdf_blocked, true);
+    static uint8_t keys[COUNT][KEY_SIZE];
+    polyseed_job* jobs[COUNT];
+    for (int i = 0; i < COUNT; ++i) {
+        res = polyseed_keygen_async_ctx(ctx, seed, (polyseed_coin)(i % 3),
+            KEY_SIZE, keys[i], &count_callback, &g_num_callbacks, &jobs[i]);
+        assert(res == POLYSEED_OK);
+    }
+    assert(polyseed_job_cancel(jobs[COUNT - 1]) == 1);
+    assert(polyseed_job_done(jobs[COUNT - 1]));
+    assert(polyseed_job_wait(jobs[COUNT - 1]) == POLYSEED_ERR_CANCELED);
+    atomic_store(&g_kdf_blocked, false);
+    for (int i = 0; i < COUNT - 1; ++i) {
+        assert(polyseed_job_wait(jobs[i]) == POLYSEED_OK);
+        assert(polyseed_job_cancel(jobs[i]) == 0);
+        polyseed_job_free(jobs[i]);
+        uint8_t key[KEY_SIZE];
+        polyseed_keygen_ctx(ctx, seed, (polyseed_coin)(i % 3), KEY_SIZE, key);
+        assert(0 == memcmp(keys[i], key, KEY_SIZE));
+    }
+    polyseed_job_free(jobs[COUNT - 1]);
+    assert(atomic_load(&g_num_callbacks) == COUNT);
+    assert(atomic_load(&g_num_canceled) == 1);
+    /* the password is copied */
+    char password[] = "password";
+    polyseed_job* job;
+    res = polyseed_crypt_async_ctx(ctx, seed, password, strlen(password),
+        NULL, NULL, &job);
+    assert(res == POLYSEED_OK);
+    memset(password, 0, sizeof(password));
+    assert(polyseed_job_wait(job) == POLYSEED_OK);
+    polyseed_job_free(job);
+    assert(polyseed_is_encrypted(seed));
+    /* jobs don't need the seed allocator */
+    assert(atomic_load(&g_num_async_allocs) == 0);
+    res = polyseed_load_into_ctx(ctx, storage, seed2);
+    assert(res == POLYSEED_OK);
+    polyseed_crypt_ctx(ctx, seed2, "password");
+    polyseed_storage storage1, storage2;
+    polyseed_store(seed, storage1);
+    polyseed_store(seed2, storage2);
+    assert(0 == memcmp(storage1, storage2, POLYSEED_SIZE));
+    polyseed_erase(seed);
+    polyseed_erase(seed2);
+    free(seed);
+    polyseed_context_free(ctx);
+    return true;
+}
+
+static bool test_crypt_with_mask(void) {
+    enum { COUNT = 3 };
+    const polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes_counter,
+        .pbkdf2_sha256 = &pbkdf2_mix_count,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+    };
+    polyseed_context* ctx;
+    polyseed_status res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    polyseed_storage storage[COUNT];
+    res = polyseed_create_batch_ctx(ctx, 0, COUNT, storage);
+    assert(res == POLYSEED_OK);
+    uint8_t* mem = malloc((COUNT + 1) * polyseed_data_size());
+    assert(mem != NULL);
+    polyseed_data* seeds[COUNT];
+    for (int i = 0; i < COUNT; ++i) {
+        seeds[i] = (polyseed_data*)&mem[i * polyseed_data_size()];
+        res = polyseed_load_into_ctx(ctx, storage[i], seeds[i]);
+        assert(res == POLYSEED_OK);
+    }
+    polyseed_data* single = (polyseed_data*)&mem[COUNT * polyseed_data_size()];
+    polyseed_mask* mask;
+    g_num_pbkdf2 = 0;
+    res = polyseed_mask_derive_ctx(ctx, "password", 8, &mask);
+    assert(res == POLYSEED_OK);
+    polyseed_crypt_batch_with_mask_ctx(ctx, seeds, COUNT, mask);
+    assert(g_num_pbkdf2 == 1);
+    /* same result as polyseed_crypt */
+    for (int i = 0; i < COUNT; ++i) {
+        assert(polyseed_is_encrypted(seeds[i]));
+        res = polyseed_load_into_ctx(ctx, storage[i], single);
+        assert(res == POLYSEED_OK);
+        polyseed_crypt_ctx(ctx, single, "password");
+        polyseed_storage encrypted1, encrypted2;
+        polyseed_store(seeds[i], encrypted1);
+        polyseed_store(single, encrypted2);
+        assert(0 == memcmp(encrypted1, encrypted2, POLYSEED_SIZE));
+    }
+    /* decrypt */
+    for (int i = 0; i < COUNT; ++i) {
+        polyseed_crypt_with_mask_ctx(ctx, seeds[i], mask);
+        polyseed_storage decrypted;
+        polyseed_store(seeds[i], decrypted);
+        assert(0 == memcmp(decrypted, storage[i], POLYSEED_SIZE));
+    }
+    polyseed_mask_free_ctx(ctx, mask);
+    free(mem);
+    polyseed_context_free(ctx);
+    return true;
+}
+
+static bool test_rotate(void) {
+    enum { COUNT = 3000, SMALL = 100 };
+    /* the rotation doesn't need large blocks from the allocator */
+    const polyseed_dependency dep = {
+        .randbytes = &gen_rand_bytes_counter,
+        .pbkdf2_sha256 = &pbkdf2_mix_count,
+        .u8_nfkd = &u8_nfkd_basic,
+        .memzero = &do_not_zero,
+        .alloc = &polyseed_secure_alloc,
+        .free = &polyseed_secure_free,
+    };
+    polyseed_context* ctx;
+    polyseed_status res = polyseed_context_create(&dep, &ctx);
+    assert(res == POLYSEED_OK);
+    static polyseed_storage plain[COUNT];
+    static polyseed_storage vault[COUNT];
+    static polyseed_storage rotated[COUNT];
+    res = polyseed_create_batch_ctx(ctx, 0, COUNT, plain);
+    assert(res == POLYSEED_OK);
+    polyseed_mask *old_mask, *new_mask;
+    res = polyseed_mask_derive_ctx(ctx, "old password", 12, &old_mask);
+    assert(res == POLYSEED_OK);
+    res = polyseed_mask_derive_ctx(ctx, "new password", 12, &new_mask);
+    assert(res == POLYSEED_OK);
+    polyseed_data* seed = malloc(polyseed_data_size());
+    assert(seed != NULL);
+    for (int i = 0; i < COUNT; ++i) {
+        res = polyseed_load_into_ctx(ctx, plain[i], seed);
+        assert(res == POLYSEED_OK);
+        polyseed_crypt_with_mask_ctx(ctx, seed, old_mask);
+        polyseed_store(seed, vault[i]);
+    }
+    /* the rotation stops at a corrupted record and can be resumed in place */
+    vault[1500][POLYSEED_SIZE - 1] ^= 1;
+    memcpy(rotated, vault, sizeof(vault));
+    size_t cursor = 0;
+    res = polyseed_rotate_ctx(ctx, old_mask, new_mask, vault, vault,
+        COUNT, &cursor);
+    assert(res == POLYSEED_ERR_CHECKSUM);
+    assert(cursor == 1500);
+    /* records at and after the cursor are not modified, including the
+       records of the following jobs */
+    assert(0 == memcmp(&vault[1500], &rotated[1500],
+        (COUNT - 1500) * sizeof(polyseed_storage)));
+    vault[1500][POLYSEED_SIZE - 1] ^= 1;
+    res = polyseed_rotate_ctx(ctx, old_mask, new_mask, vault, vault,
+        COUNT, &cursor);
+    assert(res == POLYSEED_OK);
+    assert(cursor == COUNT);
+    for (int i = 0; i < COUNT; ++i) {
+        res = polyseed_load_into_ctx(ctx, vault[i], seed);
+        assert(res == POLYSEED_OK);
+        assert(polyseed_is_encrypted(seed));
+        polyseed_crypt_with_mask_ctx(ctx, seed, new_mask);
+        polyseed_storage decrypted;
+        polyseed_store(seed, decrypted);
+        assert(0 == memcmp(decrypted, plain[i], POLYSEED_SIZE));
+    }
+    /* a small batch is rotated back by the calling thread */
+    cursor = 0;
+    res = polyseed_rotate_ctx(ctx, new_mask, old_mask, vault, vault,
+        SMALL, &cursor);
+    assert(res == POLYSEED_OK);
+    assert(cursor == SMALL);
+    for (int i = 0; i < SMALL; ++i) {
+        res = polyseed_load_into_ctx(ctx, vault[i], seed);
+        assert(res == POLYSEED_OK);
+        polyseed_crypt_with_mask_ctx(ctx, seed, old_mask);
+        polyseed_storage decrypted;
+        polyseed_store(seed, decrypted);
+        assert(0 == memcmp(decrypted, plain[i], POLYSEED_SIZE));
+    }
+    /* records that are not encrypted are not rotated */
+    memset(rotated, 0, sizeof(rotated));
+    cursor = 0;
+    res = polyseed_rotate_ctx(ctx, old_mask, new_mask, plain, rotated,
+        COUNT, &cursor);
+    assert(res == POLYSEED_ERR_NOT_ENCRYPTED);
+    assert(cursor == 0);
+    for (int i = 0; i < COUNT; ++i) {
+        for (int j = 0; j < POLYSEED_SIZE; ++j) {
+            assert(rotated[i][j] == 0);
+        }
+    }
+    polyseed_erase(seed);
+    free(seed);
+    polyseed_mask_free_ctx(ctx, old_mask);
+    polyseed_mask_free_ctx(ctx, new_mask);
+    polyseed_context_free(ctx);
+    return true;
+}
+
 int main() {
     RUN_TEST(test_inject1);
     RUN_TEST(test_num_langs);
@@ -870,8 +1878,10 @@ int main() {
     RUN_TEST(test_decode_en_suffix1);
     RUN_TEST(test_decode_en_suffix2);
     RUN_TEST(test_decode_en_space);
+    RUN_TEST(test_decode_en_whitespace);
     RUN_TEST(test_decode_en_coin);
     RUN_MULT(test_roundtrip1);
+    RUN_TEST(test_roundtrip_ko_builtin_nfkd);
     RUN_TEST(test_free1);
     RUN_TEST(test_free_null);
     RUN_TEST(test_inject2);
@@ -882,6 +1892,7 @@ int main() {
     RUN_TEST(test_store_load2);
     RUN_TEST(test_encode_es);
     RUN_TEST(test_decode_es);
+    RUN_TEST(test_decode_es_builtin_nfkd);
     RUN_TEST(test_decode_es_noaccent);
     RUN_TEST(test_decode_es_prefix1);
     RUN_TEST(test_decode_es_suffix);
@@ -899,13 +1910,34 @@ int main() {
     RUN_MULT(test_roundtrip3);
     RUN_TEST(test_encrypt);
     RUN_TEST(test_decrypt);
+    RUN_TEST(test_decrypt_n);
     RUN_TEST(test_free3);
     RUN_TEST(test_decode_garbage1);
     RUN_TEST(test_decode_garbage2);
+    RUN_TEST(test_decode_zh_garbage);
+    RUN_TEST(test_decode_mixed_script);
+    RUN_TEST(test_decode_nfkd_fallback);
+    RUN_TEST(test_decode_invalid_utf8);
+    RUN_TEST(test_decode_truncated_utf8);
     RUN_TEST(test_memleak);
     RUN_TEST(test_inject4);
     RUN_TEST(test_out_of_memory1);
     RUN_TEST(test_out_of_memory2);
+    RUN_TEST(test_out_of_memory_into);
+    RUN_TEST(test_decode_batch);
+    RUN_TEST(test_decode_batch_split);
+    RUN_TEST(test_encode_batch);
+    RUN_TEST(test_create_batch);
+    RUN_TEST(test_entropy_pool);
+    RUN_TEST(test_keygen_batch);
+    RUN_TEST(test_keygen_multi);
+    RUN_TEST(test_keygen_cache);
+    RUN_TEST(test_async);
+    RUN_TEST(test_crypt_with_mask);
+    RUN_TEST(test_rotate);
+    RUN_TEST(test_inject5);
+    RUN_TEST(test_secure_alloc);
+    RUN_TEST(test_context);
 
     printf("\nAll tests were successful\n");
     return 0;
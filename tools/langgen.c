@@ -0,0 +1,605 @@
+/* Copyright (c) 2020-2021 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+/* Compiles the wordlists into the language structures used by polyseed. */
+
+#include "../src/lang.h"
+#include "../src/unicode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern const polyseed_wordlist polyseed_wordlist_en;
+extern const polyseed_wordlist polyseed_wordlist_jp;
+extern const polyseed_wordlist polyseed_wordlist_ko;
+extern const polyseed_wordlist polyseed_wordlist_es;
+extern const polyseed_wordlist polyseed_wordlist_zh_s;
+extern const polyseed_wordlist polyseed_wordlist_zh_t;
+extern const polyseed_wordlist polyseed_wordlist_fr;
+extern const polyseed_wordlist polyseed_wordlist_it;
+extern const polyseed_wordlist polyseed_wordlist_cs;
+extern const polyseed_wordlist polyseed_wordlist_pt;
+
+typedef struct wordlist_def {
+    const char* id;
+    const polyseed_wordlist* list;
+} wordlist_def;
+
+/* The order of languages is the order of polyseed_get_lang, starting with
+   the sorted BIP-39 wordlists. */
+static const wordlist_def wordlists[] = {
+    { "en", &polyseed_wordlist_en },
+    { "jp", &polyseed_wordlist_jp },
+    { "ko", &polyseed_wordlist_ko },
+    { "es", &polyseed_wordlist_es },
+    { "fr", &polyseed_wordlist_fr },
+    { "it", &polyseed_wordlist_it },
+    { "cs", &polyseed_wordlist_cs },
+    { "pt", &polyseed_wordlist_pt },
+    { "zh_s", &polyseed_wordlist_zh_s },
+    { "zh_t", &polyseed_wordlist_zh_t },
+};
+
+#define NUM_WORDLISTS ((int)(sizeof(wordlists) / sizeof(wordlists[0])))
+
+#define MAX_DISP 65536
+
+static const char* output_path;
+
+static void fail(const char* id, const char* msg) {
+    fprintf(stderr, "langgen: %s: %s\n", id, msg);
+    remove(output_path);
+    exit(1);
+}
+
+/* Canonical composition of a validated word. Every combining mark
+   composes with the preceding character, so nothing is blocked. */
+static void compose_word(const char* word, char* out) {
+    const char* end = word + strlen(word);
+    int32_t last = polyseed_utf8_next(&word, end);
+    while (word != end) {
+        int32_t cp = polyseed_utf8_next(&word, end);
+        int32_t composed = polyseed_compose(last, cp);
+        if (composed >= 0) {
+            last = composed;
+        }
+        else {
+            out += polyseed_utf8_put(out, last);
+            last = cp;
+        }
+    }
+    out += polyseed_utf8_put(out, last);
+    *out = '\0';
+}
+
+static int compare_words(const char* key, const char* elm, bool fold) {
+    for (;;) {
+        if (fold) {
+            while (*key < 0) { /* skip non-ASCII */
+                ++key;
+            }
+            while (*elm < 0) { /* skip non-ASCII */
+                ++elm;
+            }
+        }
+        if (*key == '\0' || *key != *elm) {
+            break;
+        }
+        ++key;
+        ++elm;
+    }
+    return (*key > *elm) - (*key < *elm);
+}
+
+static void validate_wordlist(const wordlist_def* def) {
+    const polyseed_wordlist* list = def->list;
+
+    /* accented languages must be composed */
+    if (list->has_accents && !list->compose) {
+        fail(def->id, "language with accents must be composed");
+    }
+    /* normalized separator must be a space */
+    const char* sep = list->separator;
+    const char* sep_end = sep + strlen(sep);
+    if (!unicode_is_space(polyseed_utf8_next(&sep, sep_end)) ||
+        sep != sep_end) {
+        fail(def->id, "separator does not normalize to a space");
+    }
+    /* all words must be in NFKD and each combining mark must compose
+       with the preceding character, so that canonical ordering is a no-op
+       and the composed form can be calculated by compose_word */
+    for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+        const char* pos = list->words[i];
+        const char* end = pos + strlen(pos);
+        int32_t prev = -1;
+        if (*pos == '\0') {
+            fail(def->id, "empty word");
+        }
+        while (pos != end) {
+            int32_t cp = polyseed_utf8_next(&pos, end);
+            if (cp < 0) {
+                fail(def->id, "invalid UTF-8");
+            }
+            if (cp <= 0x20 || cp == 0x7f) {
+                fail(def->id, "invalid character in a word");
+            }
+            /* words outside of this repertoire are rejected, so adding
+               a new script requires extending polyseed_is_nfkd_stable */
+            if (!polyseed_is_nfkd_stable(cp)) {
+                fprintf(stderr, "langgen: %s: '%s' U+%04X\n", def->id,
+                    list->words[i], (unsigned)cp);
+                fail(def->id, "incorrectly normalized wordlist");
+            }
+            if (unicode_is_combining(cp) && polyseed_compose(prev, cp) < 0) {
+                fail(def->id, "unsupported combining sequence");
+            }
+            prev = cp;
+        }
+        /* languages that are not composed must not change by NFC */
+        if (!list->compose) {
+            char composed[POLYSEED_STR_SIZE];
+            compose_word(list->words[i], composed);
+            if (strcmp(composed, list->words[i]) != 0) {
+                fail(def->id, "composable word in a language without composition");
+            }
+        }
+    }
+    /* check the language is sorted correctly (the order of prefix
+       languages is checked by build_prefix_keys) */
+    if (list->is_sorted && !list->has_prefix) {
+        for (int i = 1; i < POLYSEED_LANG_SIZE; ++i) {
+            if (compare_words(list->words[i - 1], list->words[i],
+                list->has_accents) >= 0) {
+                fprintf(stderr, "langgen: %s: '%s' and '%s'\n", def->id,
+                    list->words[i - 1], list->words[i]);
+                fail(def->id, "incorrectly sorted wordlist");
+            }
+        }
+    }
+}
+
+#define PHF_EMPTY 0xffff
+
+static const int* bucket_count;
+
+static int compare_buckets(const void* a, const void* b) {
+    int ba = *(const int*)a;
+    int bb = *(const int*)b;
+    /* largest buckets first, ties by bucket number */
+    if (bucket_count[ba] != bucket_count[bb]) {
+        return bucket_count[bb] - bucket_count[ba];
+    }
+    return ba - bb;
+}
+
+/* Builds a perfect hash function for the given hashes. On success, slots[s]
+   contains the number of the item that is stored in slot s or PHF_EMPTY. */
+static bool build_phf(const uint64_t* hashes, int num_items,
+    unsigned num_buckets, unsigned num_slots, uint16_t* disp,
+    uint16_t* slots) {
+
+    int* count = calloc(num_buckets, sizeof(int));
+    int* start = calloc(num_buckets + 1, sizeof(int));
+    int* order = calloc(num_buckets, sizeof(int));
+    int* items = calloc(num_items, sizeof(int));
+    unsigned* tmp = calloc(num_items, sizeof(unsigned));
+    bool success = true;
+
+    if (!count || !start || !order || !items || !tmp) {
+        fail("phf", "out of memory");
+    }
+
+    /* group items by bucket */
+    for (int i = 0; i < num_items; ++i) {
+        count[phf_bucket(hashes[i], num_buckets)]++;
+    }
+    for (unsigned b = 0; b < num_buckets; ++b) {
+        start[b + 1] = start[b] + count[b];
+        order[b] = b;
+    }
+    for (int i = 0; i < num_items; ++i) {
+        unsigned b = phf_bucket(hashes[i], num_buckets);
+        items[start[b]++] = i;
+    }
+    for (unsigned b = 0; b < num_buckets; ++b) {
+        start[b] -= count[b];
+    }
+
+    bucket_count = count;
+    qsort(order, num_buckets, sizeof(int), &compare_buckets);
+
+    for (unsigned s = 0; s < num_slots; ++s) {
+        slots[s] = PHF_EMPTY;
+    }
+    memset(disp, 0, num_buckets * sizeof(uint16_t));
+
+    for (unsigned i = 0; i < num_buckets && success; ++i) {
+        int b = order[i];
+        int size = count[b];
+        const int* bucket = &items[start[b]];
+        if (size == 0) {
+            break;
+        }
+        unsigned d;
+        for (d = 0; d < MAX_DISP; ++d) {
+            bool ok = true;
+            for (int k = 0; k < size && ok; ++k) {
+                tmp[k] = phf_slot(hashes[bucket[k]], d, num_slots);
+                if (slots[tmp[k]] != PHF_EMPTY) {
+                    ok = false;
+                }
+                for (int l = 0; l < k && ok; ++l) {
+                    if (tmp[l] == tmp[k]) {
+                        ok = false;
+                    }
+                }
+            }
+            if (ok) {
+                for (int k = 0; k < size; ++k) {
+                    slots[tmp[k]] = bucket[k];
+                }
+                disp[b] = d;
+                break;
+            }
+        }
+        if (d == MAX_DISP) {
+            success = false;
+        }
+    }
+
+    free(count);
+    free(start);
+    free(order);
+    free(items);
+    free(tmp);
+    return success;
+}
+
+static void build_index(const wordlist_def* def, polyseed_lang_index* index) {
+    uint64_t hashes[POLYSEED_LANG_SIZE];
+
+    for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+        hashes[i] = lang_hash(def->list->words[i]);
+    }
+    if (!build_phf(hashes, POLYSEED_LANG_SIZE, LANG_HASH_BUCKETS,
+        POLYSEED_LANG_SIZE, index->disp, index->slots)) {
+        fail(def->id, "unable to construct the word index");
+    }
+    /* all words must be found */
+    for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+        uint64_t h = hashes[i];
+        unsigned disp = index->disp[phf_bucket(h, LANG_HASH_BUCKETS)];
+        if (index->slots[phf_slot(h, disp, POLYSEED_LANG_SIZE)] != i) {
+            fail(def->id, "incorrect wordlist index");
+        }
+    }
+}
+
+static bool is_ascii(const char* str) {
+    for (; *str != '\0'; ++str) {
+        if (*str < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void build_prefix_keys(const wordlist_def* def, uint32_t* keys) {
+    const polyseed_wordlist* list = def->list;
+    for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+        const char* rest;
+        if (!list->has_accents && !is_ascii(list->words[i])) {
+            fail(def->id, "non-ASCII word in a language without accents");
+        }
+        keys[i] = lang_prefix_key(list->words[i], list->has_accents, &rest);
+        if (i > 0 && keys[i] <= keys[i - 1]) {
+            fprintf(stderr, "langgen: %s: '%s' and '%s'\n", def->id,
+                list->words[i - 1], list->words[i]);
+            fail(def->id, "word prefixes are not unique and sorted");
+        }
+    }
+}
+
+static void write_chars(FILE* f, const char* str) {
+    for (; *str != '\0'; ++str) {
+        unsigned char c = *str;
+        if (c < 0x20 || c >= 0x7f || c == '"' || c == '\\') {
+            fprintf(f, "\\%03o", c);
+        }
+        else {
+            fputc(c, f);
+        }
+    }
+}
+
+static void write_string(FILE* f, const char* str) {
+    fputc('"', f);
+    write_chars(f, str);
+    fputc('"', f);
+}
+
+static void write_array16(FILE* f, const uint16_t* arr, int size) {
+    for (int i = 0; i < size; ++i) {
+        fprintf(f, "%s%u,", (i % 16) == 0 ? "\n        " : " ", arr[i]);
+    }
+    fprintf(f, "\n");
+}
+
+static void write_array32(FILE* f, const uint32_t* arr, int size) {
+    for (int i = 0; i < size; ++i) {
+        fprintf(f, "%s0x%08x,", (i % 8) == 0 ? "\n    " : " ", arr[i]);
+    }
+    fprintf(f, "\n");
+}
+
+typedef struct table_key {
+    uint64_t key;
+    int lang;
+    int word;
+} table_key;
+
+static int compare_table_keys(const void* a, const void* b) {
+    const table_key* ka = a;
+    const table_key* kb = b;
+    if (ka->key != kb->key) {
+        return ka->key < kb->key ? -1 : 1;
+    }
+    return ka->lang - kb->lang;
+}
+
+static uint64_t table_key_of(const polyseed_wordlist* list, int i) {
+    const char* word = list->words[i];
+    if (list->has_prefix) {
+        const char* rest;
+        return lang_prefix_key(word, true, &rest);
+    }
+    return lang_hash(word) | LANG_TAG_EXACT;
+}
+
+static void write_table(FILE* f) {
+    static table_key keys[NUM_WORDLISTS * POLYSEED_LANG_SIZE];
+    static uint64_t hashes[NUM_WORDLISTS * POLYSEED_LANG_SIZE];
+    static polyseed_lang_entry entries[NUM_WORDLISTS * POLYSEED_LANG_SIZE];
+    static uint16_t pool[NUM_WORDLISTS * POLYSEED_LANG_SIZE];
+    static uint16_t disp[LANG_TABLE_BUCKETS];
+    static uint16_t slots[LANG_TABLE_SIZE];
+    int num_keys = 0;
+    int num_entries = 0;
+    unsigned mask_prefix = 0;
+    unsigned mask_accents = 0;
+
+    for (int l = 0; l < NUM_WORDLISTS; ++l) {
+        const polyseed_wordlist* list = wordlists[l].list;
+        if (list->has_prefix) {
+            mask_prefix |= 1u << l;
+        }
+        if (list->has_accents) {
+            mask_accents |= 1u << l;
+        }
+        for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+            table_key* k = &keys[num_keys++];
+            k->key = table_key_of(list, i);
+            k->lang = l;
+            k->word = i;
+        }
+    }
+    qsort(keys, num_keys, sizeof(table_key), &compare_table_keys);
+
+    /* merge the languages of identical keys */
+    for (int i = 0; i < num_keys; ++i) {
+        const table_key* k = &keys[i];
+        if (i == 0 || k->key != keys[i - 1].key) {
+            hashes[num_entries] = lang_table_hash(k->key);
+            entries[num_entries].mask = 0;
+            entries[num_entries].pos = i;
+            num_entries++;
+        }
+        else {
+            const table_key* prev = &keys[i - 1];
+            if (prev->lang == k->lang) {
+                fail(wordlists[k->lang].id, "duplicate word key");
+            }
+            if ((k->key & LANG_TAG_EXACT) &&
+                strcmp(wordlists[prev->lang].list->words[prev->word],
+                wordlists[k->lang].list->words[k->word])) {
+                fail(wordlists[k->lang].id, "word hash collision");
+            }
+        }
+        entries[num_entries - 1].mask |= 1u << k->lang;
+        pool[i] = k->word;
+    }
+
+    if (!build_phf(hashes, num_entries, LANG_TABLE_BUCKETS, LANG_TABLE_SIZE,
+        disp, slots)) {
+        fail("table", "unable to construct the language table");
+    }
+    /* all words must be found in their language */
+    for (int i = 0; i < num_keys; ++i) {
+        const table_key* k = &keys[i];
+        uint64_t h = lang_table_hash(k->key);
+        unsigned d = disp[phf_bucket(h, LANG_TABLE_BUCKETS)];
+        uint16_t slot = slots[phf_slot(h, d, LANG_TABLE_SIZE)];
+        if (slot == PHF_EMPTY || !(entries[slot].mask & (1u << k->lang))) {
+            fail(wordlists[k->lang].id, "incorrect language table");
+        }
+        int pos = entries[slot].pos;
+        for (int l = 0; l < k->lang; ++l) {
+            pos += (entries[slot].mask >> l) & 1;
+        }
+        if (pool[pos] != k->word) {
+            fail(wordlists[k->lang].id, "incorrect language table");
+        }
+    }
+
+    fprintf(f, "static const unsigned lang_mask_prefix = 0x%03x;\n",
+        mask_prefix);
+    fprintf(f, "static const unsigned lang_mask_accents = 0x%03x;\n\n",
+        mask_accents);
+    fprintf(f, "static const uint16_t lang_table_disp[] = {");
+    write_array16(f, disp, LANG_TABLE_BUCKETS);
+    fprintf(f, "};\n\n");
+    fprintf(f, "static const polyseed_lang_entry lang_table[] = {");
+    for (int s = 0; s < LANG_TABLE_SIZE; ++s) {
+        polyseed_lang_entry entry = { 0, 0 };
+        if (slots[s] != PHF_EMPTY) {
+            entry = entries[slots[s]];
+        }
+        fprintf(f, "%s{ 0x%03x, %5u },", (s % 6) == 0 ? "\n    " : " ",
+            entry.mask, entry.pos);
+    }
+    fprintf(f, "\n};\n\n");
+    fprintf(f, "static const uint16_t lang_table_pool[] = {");
+    write_array16(f, pool, num_keys);
+    fprintf(f, "};\n\n");
+}
+
+static unsigned lang_scripts(const polyseed_wordlist* list) {
+    unsigned scripts = 0;
+    for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+        scripts |= 1u << lang_script(list->words[i]);
+    }
+    return scripts;
+}
+
+static void write_scripts(FILE* f) {
+    unsigned langs[LANG_NUM_SCRIPTS] = { 0 };
+    for (int l = 0; l < NUM_WORDLISTS; ++l) {
+        unsigned scripts = lang_scripts(wordlists[l].list);
+        for (int s = 0; s < LANG_NUM_SCRIPTS; ++s) {
+            if (scripts & (1u << s)) {
+                langs[s] |= 1u << l;
+            }
+        }
+    }
+    fprintf(f, "/* languages that have words starting with each script */\n");
+    fprintf(f, "static const unsigned lang_script_mask[] = {\n");
+    for (int s = 0; s < LANG_NUM_SCRIPTS; ++s) {
+        fprintf(f, "    0x%03x,\n", langs[s]);
+    }
+    fprintf(f, "};\n\n");
+}
+
+/* Writes the words into one blob addressed by 16-bit offsets */
+static void write_words(FILE* f, const char* prefix, const char* id,
+    const char* const* list) {
+    static polyseed_lang_word words[POLYSEED_LANG_SIZE];
+    size_t blob_size = 0;
+    fprintf(f, "static const char %sblob_%s[] =\n", prefix, id);
+    for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+        size_t length = strlen(list[i]);
+        if (blob_size + length + 1 > UINT16_MAX) {
+            fail(id, "wordlist is too large");
+        }
+        words[i].offset = (uint16_t)blob_size;
+        words[i].length = (uint16_t)length;
+        blob_size += length + 1;
+        fprintf(f, "    \"");
+        write_chars(f, list[i]);
+        fprintf(f, "\\000\"\n");
+    }
+    fprintf(f, "    ;\n\n");
+    fprintf(f, "static const polyseed_lang_word %swords_%s[] = {", prefix, id);
+    for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+        fprintf(f, "%s{ %5u, %2u },", (i % 6) == 0 ? "\n    " : " ",
+            words[i].offset, words[i].length);
+    }
+    fprintf(f, "\n};\n\n");
+}
+
+static void write_lang(FILE* f, const wordlist_def* def) {
+    const polyseed_wordlist* list = def->list;
+    bool has_index = !list->has_prefix;
+
+    if (has_index) {
+        static polyseed_lang_index index;
+        build_index(def, &index);
+        fprintf(f, "static const polyseed_lang_index index_%s = {\n", def->id);
+        fprintf(f, "    .disp = {");
+        write_array16(f, index.disp, LANG_HASH_BUCKETS);
+        fprintf(f, "    },\n");
+        fprintf(f, "    .slots = {");
+        write_array16(f, index.slots, POLYSEED_LANG_SIZE);
+        fprintf(f, "    },\n");
+        fprintf(f, "};\n\n");
+    }
+    else {
+        static uint32_t keys[POLYSEED_LANG_SIZE];
+        build_prefix_keys(def, keys);
+        fprintf(f, "static const uint32_t prefix_keys_%s[] = {", def->id);
+        write_array32(f, keys, POLYSEED_LANG_SIZE);
+        fprintf(f, "};\n\n");
+    }
+
+    write_words(f, "", def->id, list->words);
+    if (list->compose) {
+        static char composed[POLYSEED_LANG_SIZE][POLYSEED_STR_SIZE];
+        static const char* composed_words[POLYSEED_LANG_SIZE];
+        for (int i = 0; i < POLYSEED_LANG_SIZE; ++i) {
+            compose_word(list->words[i], composed[i]);
+            composed_words[i] = composed[i];
+        }
+        write_words(f, "nfc_", def->id, composed_words);
+    }
+
+    fprintf(f, "static const polyseed_lang polyseed_lang_%s = {\n",
+        def->id);
+    fprintf(f, "    .name = ");
+    write_string(f, list->name);
+    fprintf(f, ",\n    .name_en = ");
+    write_string(f, list->name_en);
+    fprintf(f, ",\n    .separator = ");
+    write_string(f, list->separator);
+    fprintf(f, ",\n");
+    fprintf(f, "    .has_prefix = %s,\n", list->has_prefix ? "true" : "false");
+    fprintf(f, "    .has_accents = %s,\n", list->has_accents ? "true" : "false");
+    if (has_index) {
+        fprintf(f, "    .index = &index_%s,\n", def->id);
+        fprintf(f, "    .prefix_keys = NULL,\n");
+    }
+    else {
+        fprintf(f, "    .index = NULL,\n");
+        fprintf(f, "    .prefix_keys = prefix_keys_%s,\n", def->id);
+    }
+    fprintf(f, "    .blob = blob_%s,\n", def->id);
+    fprintf(f, "    .words = words_%s,\n", def->id);
+    if (list->compose) {
+        fprintf(f, "    .nfc_blob = nfc_blob_%s,\n", def->id);
+        fprintf(f, "    .nfc_words = nfc_words_%s,\n", def->id);
+    }
+    else {
+        fprintf(f, "    .nfc_blob = blob_%s,\n", def->id);
+        fprintf(f, "    .nfc_words = words_%s,\n", def->id);
+    }
+    fprintf(f, "};\n\n");
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <output file>\n", argv[0]);
+        return 1;
+    }
+    output_path = argv[1];
+    FILE* f = fopen(output_path, "w");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    fprintf(f, "/* Generated by langgen. DO NOT EDIT. */\n\n");
+    for (int i = 0; i < NUM_WORDLISTS; ++i) {
+        validate_wordlist(&wordlists[i]);
+        write_lang(f, &wordlists[i]);
+    }
+    fprintf(f, "static const polyseed_lang* languages[] = {\n");
+    for (int i = 0; i < NUM_WORDLISTS; ++i) {
+        fprintf(f, "    &polyseed_lang_%s,\n", wordlists[i].id);
+    }
+    fprintf(f, "};\n\n");
+    write_scripts(f);
+    write_table(f);
+    if (fclose(f) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    return 0;
+}